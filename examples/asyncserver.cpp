@@ -0,0 +1,72 @@
+#include "../src/ucp.hpp"
+#include "../src/ucpudp.hpp"
+#include <cstdio>
+#include <memory>
+
+// echo messages until the client closes, all sessions share one thread
+ucp::Task client_handler(ucp::EventLoop &loop,
+						 std::shared_ptr<ucp::Session> session)
+{
+	char buf[1024];
+	while (true) {
+		ssize_t nread =
+			co_await ucp::async_recv(loop, *session, buf, sizeof(buf));
+		if (nread < 0) {
+			break;
+		}
+
+		std::cout << "from client " << session->address() << ": "
+				  << std::string(buf, nread) << std::endl;
+		if (co_await ucp::async_send(loop, *session, buf, nread) < 0) {
+			std::cerr << "send failed" << std::endl;
+			break;
+		}
+	}
+
+	std::cerr << "session " << session->address() << " closed" << std::endl;
+}
+
+ucp::Task acceptor(ucp::EventLoop &loop, ucp::Server<ucp::UDPSock> &server)
+{
+	while (true) {
+		auto session = co_await ucp::async_accept(loop, server);
+		if (session == nullptr) {
+			std::cerr << "accept failed" << std::endl;
+			loop.stop();
+			co_return;
+		}
+		std::cerr << "accept new session " << session->address() << std::endl;
+
+		client_handler(loop, session);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage: " << argv[0] << " <ip> <port> [profile]"
+				  << std::endl;
+		return 1;
+	}
+
+	ucp::Config config;
+	if (argc == 4 && !ucp::Config::profile(argv[3], config)) {
+		std::cerr << "unknown profile " << argv[3] << std::endl;
+		return 1;
+	}
+
+	// the loop outlives the server, which wakes its coroutines on exit
+	ucp::EventLoop loop;
+	ucp::Server<ucp::UDPSock> server;
+	server.config(config);
+	std::string address = std::string(argv[1]) + ":" + std::string(argv[2]);
+	if (!server.listen_at(address)) {
+		std::cerr << "listen on " << address << " failed" << std::endl;
+		return 1;
+	}
+
+	acceptor(loop, server);
+	loop.run();
+
+	return 0;
+}
@@ -17,6 +17,25 @@ static std::mutex client_mutex;
 
 class SimpleSock : public ucp::Sock {
 public:
+	// mock endpoints of "client" and "server"
+	static ucp::Endpoint endpoint_of(const std::string &name)
+	{
+		ucp::Endpoint endpoint;
+		endpoint.parse(name == "server" ? "127.0.0.1:2" : "127.0.0.1:1");
+		return endpoint;
+	}
+
+	bool resolve(const std::string &address,
+				 ucp::Endpoint &endpoint) override final
+	{
+		if (address != "client" && address != "server") {
+			return false;
+		}
+
+		endpoint = endpoint_of(address);
+		return true;
+	}
+
 	bool bind(const std::string &address) override final
 	{
 		if (address != "client" && address != "server" && address != "") {
@@ -36,22 +55,22 @@ public:
 	}
 
 	ssize_t send_to(const void *data, size_t size,
-					const std::string &to) override final
+					const ucp::Endpoint &to) override final
 	{
 		if (rand() % 100 < 50) {
 			// mock packet loss
 			return 0;
 		}
 
-		if (address_ == to) {
+		if (endpoint_of(address_) == to) {
 			return -1;
 		}
 
-		if (to == "server") {
+		if (to == endpoint_of("server")) {
 			std::lock_guard<std::mutex> lock(server_mutex);
 			server_msg.push(std::string((const char *)data, size));
 			return size;
-		} else if (to == "client") {
+		} else if (to == endpoint_of("client")) {
 			std::lock_guard<std::mutex> lock(client_mutex);
 			client_msg.push(std::string((const char *)data, size));
 			return size;
@@ -60,10 +79,11 @@ public:
 		}
 	}
 
-	ssize_t recv_from(void *data, size_t size, std::string &from) override final
+	ssize_t recv_from(void *data, size_t size,
+					  ucp::Endpoint &from) override final
 	{
 		if (address_ == "client") {
-			from = "server";
+			from = endpoint_of("server");
 			std::lock_guard<std::mutex> lock(client_mutex);
 			if (client_msg.empty()) {
 				return 0;
@@ -77,7 +97,7 @@ public:
 			memcpy(data, msg.data(), copy_size);
 			return copy_size;
 		} else if (address_ == "server") {
-			from = "client";
+			from = endpoint_of("client");
 			std::lock_guard<std::mutex> lock(server_mutex);
 			if (server_msg.empty()) {
 				return 0;
@@ -115,17 +135,15 @@ void server_thread_func()
 
 	char buf[1024];
 	while (true) {
-		ssize_t recv_size = session->recv(buf, 1024);
-		if (recv_size > 0) {
-			buf[recv_size] = '\0';
-			printf("server recv: %s\n", buf);
-			session->send(buf, recv_size);
-		} else if (recv_size == 0) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
-		} else {
+		ssize_t recv_size = session->recv(buf, 1024 - 1, ucp::kUCPNoTimeout);
+		if (recv_size < 0) {
 			fprintf(stderr, "server recv error\n");
 			break;
 		}
+
+		buf[recv_size] = '\0';
+		printf("server recv: %s\n", buf);
+		session->send(buf, recv_size);
 	}
 
 	fprintf(stderr, "session close\n");
@@ -151,8 +169,7 @@ int main()
 	fprintf(stderr, "client connect to server\n");
 
 	char buf[1024];
-	int flag = 0;
-	while (fgets(buf, 1024, stdin) && !flag) {
+	while (fgets(buf, 1024, stdin)) {
 		size_t len = strlen(buf);
 		if (len > 0) {
 			buf[len - 1] = '\0';
@@ -164,19 +181,14 @@ int main()
 			break;
 		}
 
-		while (true) {
-			ssize_t recv_size = client.recv(buf, 1024 - 1);
-			if (recv_size > 0) {
-				buf[recv_size] = '\0';
-				printf("client recv: %s\n", buf);
-				break;
-			} else if (recv_size == 0) {
-				std::this_thread::sleep_for(std::chrono::milliseconds(10));
-			} else {
-				fprintf(stderr, "client recv error\n");
-				flag = 1;
-			}
+		ssize_t recv_size = client.recv(buf, 1024 - 1, ucp::kUCPNoTimeout);
+		if (recv_size < 0) {
+			fprintf(stderr, "client recv error\n");
+			break;
 		}
+
+		buf[recv_size] = '\0';
+		printf("client recv: %s\n", buf);
 	}
 
 	client.close();
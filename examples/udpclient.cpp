@@ -6,12 +6,20 @@
 
 int main(int argc, char *argv[])
 {
-	if (argc != 3) {
-		std::cerr << "Usage: " << argv[0] << " <ip> <port>" << std::endl;
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage: " << argv[0] << " <ip> <port> [profile]"
+				  << std::endl;
+		return 1;
+	}
+
+	ucp::Config config;
+	if (argc == 4 && !ucp::Config::profile(argv[3], config)) {
+		std::cerr << "unknown profile " << argv[3] << std::endl;
 		return 1;
 	}
 
 	ucp::Client<ucp::UDPSock> client;
+	client.config(config);
 
 	std::string remote_addr = std::string(argv[1]) + ":" + std::string(argv[2]);
 	if (!client.connect(remote_addr)) {
@@ -30,24 +38,15 @@ int main(int argc, char *argv[])
 		}
 
 		if (n > 0) {
-			ssize_t nread = 0;
 			char buf[1024];
-			while (nread == 0) {
-				nread = client.recv(buf, sizeof(buf));
-				if (nread < 0) {
-					std::cerr << "recv failed" << std::endl;
-					return 1;
-				}
-
-				if (nread > 0) {
-					std::cout << "from server: " << std::string(buf, nread)
-							  << std::endl;
-					break;
-				}
-
-				std::this_thread::sleep_for(
-					std::chrono::milliseconds(10)); // wait for data
+			ssize_t nread = client.recv(buf, sizeof(buf), ucp::kUCPNoTimeout);
+			if (nread < 0) {
+				std::cerr << "recv failed" << std::endl;
+				return 1;
 			}
+
+			std::cout << "from server: " << std::string(buf, nread)
+					  << std::endl;
 		} else {
 			std::cout << "send 0" << std::endl;
 		}
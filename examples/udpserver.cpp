@@ -3,60 +3,56 @@
 #include <cstdio>
 #include <memory>
 
-void client_handler(std::shared_ptr<ucp::Session> session)
+void on_message(std::shared_ptr<ucp::Session> session, ucp::MessageView &view)
 {
 	char buf[1024];
-	ssize_t nread = 0;
-
-	while (true) {
-		nread = session->recv(buf, sizeof(buf));
-		if (nread < 0) {
-			std::cerr << "recv failed" << std::endl;
-			return;
-		}
-
-		if (nread > 0) {
-			std::cout << "from client " << session->address() << ": "
-					  << std::string(buf, nread) << std::endl;
-			ssize_t n = session->send(buf, nread);
-			if (n < 0) {
-				std::cerr << "send failed" << std::endl;
-				return;
-			}
-
-			session->close();
-			break;
-		}
-
-		std::this_thread::sleep_for(
-			std::chrono::milliseconds(10)); // wait for data
+	size_t nread = view.copy_to(buf, sizeof(buf));
+
+	std::cout << "from client " << session->address() << ": "
+			  << std::string(buf, nread) << std::endl;
+	ssize_t n = session->send(buf, nread);
+	if (n < 0) {
+		std::cerr << "send failed" << std::endl;
+		return;
 	}
+
+	session->close();
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc != 3) {
-		std::cerr << "Usage: " << argv[0] << " <ip> <port>" << std::endl;
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage: " << argv[0] << " <ip> <port> [profile]"
+				  << std::endl;
+		return 1;
+	}
+
+	ucp::Config config;
+	if (argc == 4 && !ucp::Config::profile(argv[3], config)) {
+		std::cerr << "unknown profile " << argv[3] << std::endl;
 		return 1;
 	}
 
+	// handlers of all sessions run on a pool sized to the cores, which
+	// outlives the server
+	ucp::Executor executor;
 	ucp::Server<ucp::UDPSock> server;
+	server.config(config);
 	std::string address = std::string(argv[1]) + ":" + std::string(argv[2]);
 	if (!server.listen_at(address)) {
 		std::cerr << "listen on " << address << " failed" << std::endl;
 		return 1;
 	}
 
-	while (true) {
-		auto session = server.accept();
-		if (session == nullptr) {
-			std::cerr << "accept failed" << std::endl;
-			return 1;
-		}
+	ucp::Handlers handlers;
+	handlers.on_accept = [](std::shared_ptr<ucp::Session> session) {
 		std::cerr << "accept new session " << session->address() << std::endl;
+	};
+	handlers.on_message = on_message;
+	server.handlers(handlers, executor.dispatcher());
 
-		std::thread t(client_handler, session);
-		t.detach();
+	while (true) { // the network threads and the executor do the work
+		std::this_thread::sleep_for(std::chrono::seconds(1));
 	}
 
 	return 0;
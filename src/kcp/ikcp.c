@@ -30,6 +30,7 @@ const IUINT32 IKCP_CMD_PUSH = 81;		// cmd: push data
 const IUINT32 IKCP_CMD_ACK  = 82;		// cmd: ack
 const IUINT32 IKCP_CMD_WASK = 83;		// cmd: window probe (ask)
 const IUINT32 IKCP_CMD_WINS = 84;		// cmd: window size (tell)
+const IUINT32 IKCP_CMD_SACK = 85;		// cmd: ack sn ranges
 const IUINT32 IKCP_ASK_SEND = 1;		// need to send IKCP_CMD_WASK
 const IUINT32 IKCP_ASK_TELL = 2;		// need to send IKCP_CMD_WINS
 const IUINT32 IKCP_WND_SND = 32;
@@ -212,6 +213,20 @@ static int ikcp_output(ikcpcb *kcp, const void *data, int size)
 	return kcp->output((const char*)data, size, kcp, kcp->user);
 }
 
+// output segment in pieces
+static int ikcp_outputv(ikcpcb *kcp, const IKCPVEC *vec, int count)
+{
+	assert(kcp);
+	assert(kcp->outputv);
+	if (ikcp_canlog(kcp, IKCP_LOG_OUTPUT)) {
+		long size = 0;
+		int i;
+		for (i = 0; i < count; i++) size += vec[i].len;
+		ikcp_log(kcp, IKCP_LOG_OUTPUT, "[RO] %ld bytes", size);
+	}
+	return kcp->outputv(vec, count, kcp, kcp->user);
+}
+
 // output queue
 void ikcp_qprint(const char *name, const struct IQUEUEHEAD *head)
 {
@@ -232,6 +247,135 @@ void ikcp_qprint(const char *name, const struct IQUEUEHEAD *head)
 // create a new kcpcb
 //---------------------------------------------------------------------
 ikcpcb* ikcp_create(IUINT32 conv, void *user)
+{
+	return ikcp_create_ex(conv, user, 0);
+}
+
+
+//---------------------------------------------------------------------
+// receive ring: slots >= rcv_wnd and power of 2, so segments inside
+// the window never share a slot
+//---------------------------------------------------------------------
+static IUINT32 ikcp_ring_size(IUINT32 rcv_wnd)
+{
+	IUINT32 size = 1;
+	while (size < rcv_wnd) size <<= 1;
+	return size;
+}
+
+static int ikcp_ring_resize(ikcpcb *kcp, IUINT32 rcv_wnd)
+{
+	IUINT32 size = ikcp_ring_size(rcv_wnd), i;
+	IKCPSEG **ring;
+	if (size <= kcp->rcv_ring_size) return 0;
+	ring = (IKCPSEG**)ikcp_malloc(sizeof(IKCPSEG*) * size);
+	if (ring == NULL) return -1;
+	memset(ring, 0, sizeof(IKCPSEG*) * size);
+	if (kcp->rcv_ring) {
+		for (i = 0; i < kcp->rcv_ring_size; i++) {
+			IKCPSEG *seg = kcp->rcv_ring[i];
+			if (seg) ring[seg->sn & (size - 1)] = seg;
+		}
+		ikcp_free(kcp->rcv_ring);
+	}
+	kcp->rcv_ring = ring;
+	kcp->rcv_ring_size = size;
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// send heap: snd_buf segments already sent, ordered by resendts
+//---------------------------------------------------------------------
+static void ikcp_heap_swap(ikcpcb *kcp, IUINT32 a, IUINT32 b)
+{
+	IKCPSEG *seg = kcp->snd_heap[a];
+	kcp->snd_heap[a] = kcp->snd_heap[b];
+	kcp->snd_heap[b] = seg;
+	kcp->snd_heap[a]->heap = a;
+	kcp->snd_heap[b]->heap = b;
+}
+
+static void ikcp_heap_up(ikcpcb *kcp, IUINT32 i)
+{
+	while (i > 0) {
+		IUINT32 parent = (i - 1) / 2;
+		if (_itimediff(kcp->snd_heap[i]->resendts, 
+			kcp->snd_heap[parent]->resendts) >= 0) 
+			break;
+		ikcp_heap_swap(kcp, i, parent);
+		i = parent;
+	}
+}
+
+static void ikcp_heap_down(ikcpcb *kcp, IUINT32 i)
+{
+	while (1) {
+		IUINT32 left = i * 2 + 1, right = left + 1, min = i;
+		if (left < kcp->snd_heap_size && 
+			_itimediff(kcp->snd_heap[left]->resendts, 
+			kcp->snd_heap[min]->resendts) < 0) 
+			min = left;
+		if (right < kcp->snd_heap_size && 
+			_itimediff(kcp->snd_heap[right]->resendts, 
+			kcp->snd_heap[min]->resendts) < 0) 
+			min = right;
+		if (min == i) break;
+		ikcp_heap_swap(kcp, i, min);
+		i = min;
+	}
+}
+
+// resendts of the i-th segment changed
+static void ikcp_heap_fix(ikcpcb *kcp, IUINT32 i)
+{
+	ikcp_heap_down(kcp, i);
+	ikcp_heap_up(kcp, i);
+}
+
+static void ikcp_heap_push(ikcpcb *kcp, IKCPSEG *seg)
+{
+	if (kcp->snd_heap_size == kcp->snd_heap_cap) {
+		IUINT32 cap = kcp->snd_heap_cap * 2;
+		IKCPSEG **heap = (IKCPSEG**)ikcp_malloc(sizeof(IKCPSEG*) * cap);
+		if (heap == NULL) {
+			assert(heap != NULL);
+			abort();
+		}
+		memcpy(heap, kcp->snd_heap, sizeof(IKCPSEG*) * kcp->snd_heap_size);
+		ikcp_free(kcp->snd_heap);
+		kcp->snd_heap = heap;
+		kcp->snd_heap_cap = cap;
+	}
+	seg->heap = kcp->snd_heap_size++;
+	kcp->snd_heap[seg->heap] = seg;
+	ikcp_heap_up(kcp, seg->heap);
+}
+
+static void ikcp_heap_remove(ikcpcb *kcp, IKCPSEG *seg)
+{
+	IUINT32 i = seg->heap;
+	IUINT32 last = --kcp->snd_heap_size;
+	if (i != last) {
+		kcp->snd_heap[i] = kcp->snd_heap[last];
+		kcp->snd_heap[i]->heap = i;
+		ikcp_heap_fix(kcp, i);
+	}
+}
+
+// segment leaves snd_buf, drop it from the indexes
+static void ikcp_snd_buf_unlink(ikcpcb *kcp, IKCPSEG *seg)
+{
+	if (kcp->snd_heap == NULL) return;
+	if (seg->xmit > 0) ikcp_heap_remove(kcp, seg);
+	if (!iqueue_is_empty(&seg->fastnode)) iqueue_del_init(&seg->fastnode);
+}
+
+
+//---------------------------------------------------------------------
+// create a new kcpcb with flags
+//---------------------------------------------------------------------
+ikcpcb* ikcp_create_ex(IUINT32 conv, void *user, int flags)
 {
 	ikcpcb *kcp = (ikcpcb*)ikcp_malloc(sizeof(struct IKCPCB));
 	if (kcp == NULL) return NULL;
@@ -253,6 +397,7 @@ ikcpcb* ikcp_create(IUINT32 conv, void *user)
 	kcp->mtu = IKCP_MTU_DEF;
 	kcp->mss = kcp->mtu - IKCP_OVERHEAD;
 	kcp->stream = 0;
+	kcp->reserved = 0;
 
 	kcp->buffer = (char*)ikcp_malloc((kcp->mtu + IKCP_OVERHEAD) * 3);
 	if (kcp->buffer == NULL) {
@@ -264,6 +409,12 @@ ikcpcb* ikcp_create(IUINT32 conv, void *user)
 	iqueue_init(&kcp->rcv_queue);
 	iqueue_init(&kcp->snd_buf);
 	iqueue_init(&kcp->rcv_buf);
+	kcp->rcv_ring = NULL;
+	kcp->rcv_ring_size = 0;
+	kcp->snd_heap = NULL;
+	kcp->snd_heap_size = 0;
+	kcp->snd_heap_cap = 0;
+	iqueue_init(&kcp->snd_fast);
 	kcp->nrcv_buf = 0;
 	kcp->nsnd_buf = 0;
 	kcp->nrcv_que = 0;
@@ -289,7 +440,30 @@ ikcpcb* ikcp_create(IUINT32 conv, void *user)
 	kcp->xmit = 0;
 	kcp->dead_link = IKCP_DEADLINK;
 	kcp->output = NULL;
+	kcp->outputv = NULL;
 	kcp->writelog = NULL;
+	kcp->sack = (flags & IKCP_FLAG_SACK)? 1 : 0;
+	kcp->cc = NULL;
+
+	if (flags & IKCP_FLAG_SND_HEAP) {
+		kcp->snd_heap_cap = 32;
+		kcp->snd_heap = (IKCPSEG**)ikcp_malloc(sizeof(IKCPSEG*) * 
+			kcp->snd_heap_cap);
+		if (kcp->snd_heap == NULL) {
+			ikcp_free(kcp->buffer);
+			ikcp_free(kcp);
+			return NULL;
+		}
+	}
+
+	if (flags & IKCP_FLAG_RCV_RING) {
+		if (ikcp_ring_resize(kcp, kcp->rcv_wnd) != 0) {
+			if (kcp->snd_heap) ikcp_free(kcp->snd_heap);
+			ikcp_free(kcp->buffer);
+			ikcp_free(kcp);
+			return NULL;
+		}
+	}
 
 	return kcp;
 }
@@ -313,6 +487,18 @@ void ikcp_release(ikcpcb *kcp)
 			iqueue_del(&seg->node);
 			ikcp_segment_delete(kcp, seg);
 		}
+		if (kcp->rcv_ring) {
+			IUINT32 i;
+			for (i = 0; i < kcp->rcv_ring_size; i++) {
+				if (kcp->rcv_ring[i]) {
+					ikcp_segment_delete(kcp, kcp->rcv_ring[i]);
+				}
+			}
+			ikcp_free(kcp->rcv_ring);
+		}
+		if (kcp->snd_heap) {
+			ikcp_free(kcp->snd_heap);
+		}
 		while (!iqueue_is_empty(&kcp->snd_queue)) {
 			seg = iqueue_entry(kcp->snd_queue.next, IKCPSEG, node);
 			iqueue_del(&seg->node);
@@ -337,6 +523,8 @@ void ikcp_release(ikcpcb *kcp)
 		kcp->ackcount = 0;
 		kcp->buffer = NULL;
 		kcp->acklist = NULL;
+		kcp->rcv_ring = NULL;
+		kcp->snd_heap = NULL;
 		ikcp_free(kcp);
 	}
 }
@@ -352,6 +540,50 @@ void ikcp_setoutput(ikcpcb *kcp, int (*output)(const char *buf, int len,
 }
 
 
+//---------------------------------------------------------------------
+// set vectored output callback
+//---------------------------------------------------------------------
+void ikcp_setoutputv(ikcpcb *kcp, int (*outputv)(const IKCPVEC *vec,
+	int count, ikcpcb *kcp, void *user))
+{
+	kcp->outputv = outputv;
+}
+
+
+//---------------------------------------------------------------------
+// move available data from rcv_buf (or rcv_ring) -> rcv_queue
+//---------------------------------------------------------------------
+static void ikcp_rcv_buf_move(ikcpcb *kcp)
+{
+	if (kcp->rcv_ring) {
+		IUINT32 mask = kcp->rcv_ring_size - 1;
+		while (kcp->nrcv_que < kcp->rcv_wnd) {
+			IKCPSEG *seg = kcp->rcv_ring[kcp->rcv_nxt & mask];
+			if (seg == NULL) break;
+			kcp->rcv_ring[kcp->rcv_nxt & mask] = NULL;
+			kcp->nrcv_buf--;
+			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
+			kcp->nrcv_que++;
+			kcp->rcv_nxt++;
+		}
+		return;
+	}
+
+	while (! iqueue_is_empty(&kcp->rcv_buf)) {
+		IKCPSEG *seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
+		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
+			iqueue_del(&seg->node);
+			kcp->nrcv_buf--;
+			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
+			kcp->nrcv_que++;
+			kcp->rcv_nxt++;
+		}	else {
+			break;
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // user/upper level recv: returns size, returns below zero for EAGAIN
 //---------------------------------------------------------------------
@@ -411,18 +643,7 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len)
 	assert(len == peeksize);
 
 	// move available data from rcv_buf -> rcv_queue
-	while (! iqueue_is_empty(&kcp->rcv_buf)) {
-		seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-			iqueue_del(&seg->node);
-			kcp->nrcv_buf--;
-			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-			kcp->nrcv_que++;
-			kcp->rcv_nxt++;
-		}	else {
-			break;
-		}
-	}
+	ikcp_rcv_buf_move(kcp);
 
 	// fast recover
 	if (kcp->nrcv_que < kcp->rcv_wnd && recover) {
@@ -435,6 +656,73 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len)
 }
 
 
+//---------------------------------------------------------------------
+// recv in place, the segments of a message are handed to the caller
+//---------------------------------------------------------------------
+IKCPSEG *ikcp_recv_segments(ikcpcb *kcp, int *len)
+{
+	struct IQUEUEHEAD *p, *next;
+	IKCPSEG *first, *seg;
+	int peeksize;
+	int recover = 0;
+	assert(kcp);
+
+	if (iqueue_is_empty(&kcp->rcv_queue))
+		return NULL;
+
+	peeksize = ikcp_peeksize(kcp);
+
+	if (peeksize < 0) 
+		return NULL;
+
+	if (kcp->nrcv_que >= kcp->rcv_wnd)
+		recover = 1;
+
+	first = iqueue_entry(kcp->rcv_queue.next, IKCPSEG, node);
+
+	// unlink fragments, chain them by node.next
+	for (p = kcp->rcv_queue.next; p != &kcp->rcv_queue; p = next) {
+		int fragment;
+		seg = iqueue_entry(p, IKCPSEG, node);
+		next = p->next;
+		fragment = seg->frg;
+
+		if (ikcp_canlog(kcp, IKCP_LOG_RECV)) {
+			ikcp_log(kcp, IKCP_LOG_RECV, "recv sn=%lu", (unsigned long)seg->sn);
+		}
+
+		iqueue_del(&seg->node);
+		kcp->nrcv_que--;
+
+		if (fragment == 0) 
+			break;
+
+		seg->node.next = next;
+	}
+
+	// move available data from rcv_buf -> rcv_queue
+	ikcp_rcv_buf_move(kcp);
+
+	// fast recover
+	if (kcp->nrcv_que < kcp->rcv_wnd && recover) {
+		kcp->probe |= IKCP_ASK_TELL;
+	}
+
+	if (len) *len = peeksize;
+	return first;
+}
+
+void ikcp_recv_release(IKCPSEG *seg)
+{
+	while (seg) {
+		IKCPSEG *next = (seg->node.next)? 
+			iqueue_entry(seg->node.next, IKCPSEG, node) : NULL;
+		ikcp_segment_delete(NULL, seg);
+		seg = next;
+	}
+}
+
+
 //---------------------------------------------------------------------
 // peek data size
 //---------------------------------------------------------------------
@@ -562,6 +850,9 @@ static void ikcp_update_ack(ikcpcb *kcp, IINT32 rtt)
 	}
 	rto = kcp->rx_srtt + _imax_(kcp->interval, 4 * kcp->rx_rttval);
 	kcp->rx_rto = _ibound_(kcp->rx_minrto, rto, IKCP_RTO_MAX);
+	if (kcp->cc && kcp->cc->on_rtt) {
+		kcp->cc->on_rtt(kcp, kcp->cc->user, rtt);
+	}
 }
 
 static void ikcp_shrink_buf(ikcpcb *kcp)
@@ -587,6 +878,7 @@ static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn)
 		next = p->next;
 		if (sn == seg->sn) {
 			iqueue_del(p);
+			ikcp_snd_buf_unlink(kcp, seg);
 			ikcp_segment_delete(kcp, seg);
 			kcp->nsnd_buf--;
 			break;
@@ -605,6 +897,7 @@ static void ikcp_parse_una(ikcpcb *kcp, IUINT32 una)
 		next = p->next;
 		if (_itimediff(una, seg->sn) > 0) {
 			iqueue_del(p);
+			ikcp_snd_buf_unlink(kcp, seg);
 			ikcp_segment_delete(kcp, seg);
 			kcp->nsnd_buf--;
 		}	else {
@@ -613,6 +906,35 @@ static void ikcp_parse_una(ikcpcb *kcp, IUINT32 una)
 	}
 }
 
+// ranges are [start, end) pairs in ascending order, snd_buf is walked once
+static void ikcp_parse_sack(ikcpcb *kcp, const char *data, IUINT32 count)
+{
+	struct IQUEUEHEAD *p = kcp->snd_buf.next, *next;
+	IUINT32 i, start, end;
+
+	for (i = 0; i < count; i++) {
+		data = ikcp_decode32u(data, &start);
+		data = ikcp_decode32u(data, &end);
+		if (_itimediff(end, start) <= 0) continue;
+		while (p != &kcp->snd_buf) {
+			IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+			next = p->next;
+			if (_itimediff(seg->sn, start) < 0) {
+				p = next;
+				continue;
+			}
+			if (_itimediff(seg->sn, end) >= 0) {
+				break;
+			}
+			iqueue_del(p);
+			ikcp_snd_buf_unlink(kcp, seg);
+			ikcp_segment_delete(kcp, seg);
+			kcp->nsnd_buf--;
+			p = next;
+		}
+	}
+}
+
 static void ikcp_parse_fastack(ikcpcb *kcp, IUINT32 sn, IUINT32 ts)
 {
 	struct IQUEUEHEAD *p, *next;
@@ -633,6 +955,11 @@ static void ikcp_parse_fastack(ikcpcb *kcp, IUINT32 sn, IUINT32 ts)
 			if (_itimediff(ts, seg->ts) >= 0)
 				seg->fastack++;
 		#endif
+			if (kcp->snd_heap && kcp->fastresend > 0 && 
+				seg->fastack >= (IUINT32)kcp->fastresend &&
+				iqueue_is_empty(&seg->fastnode)) {
+				iqueue_add_tail(&seg->fastnode, &kcp->snd_fast);
+			}
 		}
 	}
 }
@@ -699,6 +1026,19 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 		return;
 	}
 
+	if (kcp->rcv_ring) {
+		IKCPSEG **slot = &kcp->rcv_ring[sn & (kcp->rcv_ring_size - 1)];
+		if (*slot == NULL) {
+			*slot = newseg;
+			kcp->nrcv_buf++;
+		}	else {
+			assert((*slot)->sn == sn);
+			ikcp_segment_delete(kcp, newseg);
+		}
+		ikcp_rcv_buf_move(kcp);
+		return;
+	}
+
 	for (p = kcp->rcv_buf.prev; p != &kcp->rcv_buf; p = prev) {
 		IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
 		prev = p->prev;
@@ -725,18 +1065,7 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 #endif
 
 	// move available data from rcv_buf -> rcv_queue
-	while (! iqueue_is_empty(&kcp->rcv_buf)) {
-		IKCPSEG *seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-			iqueue_del(&seg->node);
-			kcp->nrcv_buf--;
-			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-			kcp->nrcv_que++;
-			kcp->rcv_nxt++;
-		}	else {
-			break;
-		}
-	}
+	ikcp_rcv_buf_move(kcp);
 
 #if 0
 	ikcp_qprint("queue", &kcp->rcv_queue);
@@ -756,6 +1085,7 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 int ikcp_input(ikcpcb *kcp, const char *data, long size)
 {
 	IUINT32 prev_una = kcp->snd_una;
+	IUINT32 prev_nsnd_buf = kcp->nsnd_buf;
 	IUINT32 maxack = 0, latest_ts = 0;
 	int flag = 0;
 
@@ -789,18 +1119,24 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 		if ((long)size < (long)len || (int)len < 0) return -2;
 
 		if (cmd != IKCP_CMD_PUSH && cmd != IKCP_CMD_ACK &&
-			cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS) 
+			cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS &&
+			cmd != IKCP_CMD_SACK) 
 			return -3;
 
 		kcp->rmt_wnd = wnd;
 		ikcp_parse_una(kcp, una);
 		ikcp_shrink_buf(kcp);
 
-		if (cmd == IKCP_CMD_ACK) {
+		if (cmd == IKCP_CMD_ACK || cmd == IKCP_CMD_SACK) {
 			if (_itimediff(kcp->current, ts) >= 0) {
 				ikcp_update_ack(kcp, _itimediff(kcp->current, ts));
 			}
-			ikcp_parse_ack(kcp, sn);
+			if (cmd == IKCP_CMD_ACK) {
+				ikcp_parse_ack(kcp, sn);
+			}	else {
+				// sn is the highest one acked
+				ikcp_parse_sack(kcp, data, len / 8);
+			}
 			ikcp_shrink_buf(kcp);
 			if (flag == 0) {
 				flag = 1;
@@ -879,7 +1215,13 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 		ikcp_parse_fastack(kcp, maxack, latest_ts);
 	}
 
-	if (_itimediff(kcp->snd_una, prev_una) > 0) {
+	if (kcp->cc) {
+		if (kcp->cc->on_ack && kcp->nsnd_buf < prev_nsnd_buf) {
+			kcp->cc->on_ack(kcp, kcp->cc->user, 
+				prev_nsnd_buf - kcp->nsnd_buf);
+		}
+	}
+	else if (_itimediff(kcp->snd_una, prev_una) > 0) {
 		if (kcp->cwnd < kcp->rmt_wnd) {
 			IUINT32 mss = kcp->mss;
 			if (kcp->cwnd < kcp->ssthresh) {
@@ -935,15 +1277,126 @@ static int ikcp_wnd_unused(const ikcpcb *kcp)
 //---------------------------------------------------------------------
 // ikcp_flush
 //---------------------------------------------------------------------
+static char *ikcp_flush_segment(ikcpcb *kcp, IKCPSEG *segment, char *ptr,
+	IUINT32 wnd)
+{
+	char *buffer = kcp->buffer + kcp->reserved;
+	int size, need;
+
+	segment->ts = kcp->current;
+	segment->wnd = wnd;
+	segment->una = kcp->rcv_nxt;
+
+	if (kcp->cc && kcp->cc->on_send) {
+		kcp->cc->on_send(kcp, kcp->cc->user, segment->sn, segment->xmit);
+	}
+
+	size = (int)(ptr - buffer);
+	need = IKCP_OVERHEAD + segment->len;
+
+	if (size + need > (int)kcp->mtu) {
+		ikcp_output(kcp, buffer, size);
+		ptr = buffer;
+	}
+
+	ptr = ikcp_encode_seg(ptr, segment);
+
+	if (kcp->outputv && segment->len > 0 && segment->len >= kcp->mss / 2) {
+		// the buffer and the data go out as is, without copying data
+		IKCPVEC vec[2];
+		vec[0].data = buffer;
+		vec[0].len = (int)(ptr - buffer);
+		vec[1].data = segment->data;
+		vec[1].len = (int)segment->len;
+		ikcp_outputv(kcp, vec, 2);
+		ptr = buffer;
+	}	else if (segment->len > 0) {
+		memcpy(ptr, segment->data, segment->len);
+		ptr += segment->len;
+	}
+
+	if (segment->xmit >= kcp->dead_link) {
+		kcp->state = (IUINT32)-1;
+	}
+
+	return ptr;
+}
+
+static int ikcp_sn_compare(const void *a, const void *b)
+{
+	long diff = _itimediff(*(const IUINT32*)a, *(const IUINT32*)b);
+	return (diff > 0) - (diff < 0);
+}
+
+// encode acklist as IKCP_CMD_SACK segments, one range per run of sn
+static char *ikcp_flush_sack(ikcpcb *kcp, char *ptr, const IKCPSEG *seg)
+{
+	char *buffer = kcp->buffer + kcp->reserved;
+	char *head = NULL;
+	IUINT32 *sns = kcp->acklist;
+	IUINT32 count = kcp->ackcount, i, start, end, ranges = 0;
+	IKCPSEG sack = *seg;
+	int size;
+
+	// echo the newest ts, gather sn in the front of acklist
+	sack.cmd = IKCP_CMD_SACK;
+	sack.ts = kcp->acklist[1];
+	for (i = 0; i < count; i++) {
+		IUINT32 ts = kcp->acklist[i * 2 + 1];
+		if (_itimediff(ts, sack.ts) > 0) sack.ts = ts;
+		sns[i] = kcp->acklist[i * 2 + 0];
+	}
+
+	qsort(sns, count, sizeof(IUINT32), ikcp_sn_compare);
+	sack.sn = sns[count - 1];
+
+	start = sns[0];
+	end = start + 1;
+	for (i = 1; i <= count; i++) {
+		if (i < count && _itimediff(sns[i], end) <= 0) {
+			if (sns[i] == end) end++;	// else duplicated
+			continue;
+		}
+
+		if (head == NULL || (int)(ptr - buffer) + 8 > (int)kcp->mtu) {
+			if (head != NULL) {
+				sack.len = ranges * 8;
+				ikcp_encode_seg(head, &sack);
+			}
+			size = (int)(ptr - buffer);
+			if (size + (int)IKCP_OVERHEAD + 8 > (int)kcp->mtu) {
+				ikcp_output(kcp, buffer, size);
+				ptr = buffer;
+			}
+			head = ptr;
+			ptr += IKCP_OVERHEAD;
+			ranges = 0;
+		}
+
+		ptr = ikcp_encode32u(ptr, start);
+		ptr = ikcp_encode32u(ptr, end);
+		ranges++;
+
+		if (i < count) {
+			start = sns[i];
+			end = start + 1;
+		}
+	}
+
+	sack.len = ranges * 8;
+	ikcp_encode_seg(head, &sack);
+	return ptr;
+}
+
 void ikcp_flush(ikcpcb *kcp)
 {
 	IUINT32 current = kcp->current;
-	char *buffer = kcp->buffer;
+	char *buffer = kcp->buffer + kcp->reserved;
 	char *ptr = buffer;
 	int count, size, i;
 	IUINT32 resent, cwnd;
 	IUINT32 rtomin;
-	struct IQUEUEHEAD *p;
+	struct IQUEUEHEAD *p, *next, *last;
 	int change = 0;
 	int lost = 0;
 	IKCPSEG seg;
@@ -962,6 +1415,10 @@ void ikcp_flush(ikcpcb *kcp)
 
 	// flush acknowledges
 	count = kcp->ackcount;
+	if (kcp->sack && count > 0) {
+		ptr = ikcp_flush_sack(kcp, ptr, &seg);
+		count = 0;
+	}
 	for (i = 0; i < count; i++) {
 		size = (int)(ptr - buffer);
 		if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
@@ -1022,9 +1479,10 @@ void ikcp_flush(ikcpcb *kcp)
 
 	// calculate window size
 	cwnd = _imin_(kcp->snd_wnd, kcp->rmt_wnd);
-	if (kcp->nocwnd == 0) cwnd = _imin_(kcp->cwnd, cwnd);
+	if (kcp->nocwnd == 0 || kcp->cc) cwnd = _imin_(kcp->cwnd, cwnd);
 
 	// move data from snd_queue to snd_buf
+	last = kcp->snd_buf.prev;
 	while (_itimediff(kcp->snd_nxt, kcp->snd_una + cwnd) < 0) {
 		IKCPSEG *newseg;
 		if (iqueue_is_empty(&kcp->snd_queue)) break;
@@ -1046,6 +1504,7 @@ void ikcp_flush(ikcpcb *kcp)
 		newseg->rto = kcp->rx_rto;
 		newseg->fastack = 0;
 		newseg->xmit = 0;
+		iqueue_init(&newseg->fastnode);
 	}
 
 	// calculate resent
@@ -1053,17 +1512,13 @@ void ikcp_flush(ikcpcb *kcp)
 	rtomin = (kcp->nodelay == 0)? (kcp->rx_rto >> 3) : 0;
 
 	// flush data segments
-	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
-		IKCPSEG *segment = iqueue_entry(p, IKCPSEG, node);
-		int needsend = 0;
-		if (segment->xmit == 0) {
-			needsend = 1;
-			segment->xmit++;
-			segment->rto = kcp->rx_rto;
-			segment->resendts = current + segment->rto + rtomin;
-		}
-		else if (_itimediff(current, segment->resendts) >= 0) {
-			needsend = 1;
+	if (kcp->snd_heap) {
+		IUINT32 due = kcp->snd_heap_size;
+
+		// timed out, the earliest resendts is on the top
+		while (due-- > 0) {
+			IKCPSEG *segment = kcp->snd_heap[0];
+			if (_itimediff(current, segment->resendts) < 0) break;
 			segment->xmit++;
 			kcp->xmit++;
 			if (kcp->nodelay == 0) {
@@ -1074,42 +1529,75 @@ void ikcp_flush(ikcpcb *kcp)
 				segment->rto += step / 2;
 			}
 			segment->resendts = current + segment->rto;
+			ikcp_heap_down(kcp, 0);
 			lost = 1;
+			ptr = ikcp_flush_segment(kcp, segment, ptr, seg.wnd);
 		}
-		else if (segment->fastack >= resent) {
+
+		// fast retransmit, skip the ones just resent by timeout
+		for (p = kcp->snd_fast.next; p != &kcp->snd_fast; p = next) {
+			IKCPSEG *segment = iqueue_entry(p, IKCPSEG, fastnode);
+			next = p->next;
+			if (segment->ts == current) continue;
+			iqueue_del_init(p);
+			if (segment->fastack < resent) continue;
 			if ((int)segment->xmit <= kcp->fastlimit || 
 				kcp->fastlimit <= 0) {
-				needsend = 1;
 				segment->xmit++;
 				segment->fastack = 0;
 				segment->resendts = current + segment->rto;
+				ikcp_heap_fix(kcp, segment->heap);
 				change++;
+				ptr = ikcp_flush_segment(kcp, segment, ptr, seg.wnd);
 			}
 		}
 
-		if (needsend) {
-			int need;
-			segment->ts = current;
-			segment->wnd = seg.wnd;
-			segment->una = kcp->rcv_nxt;
-
-			size = (int)(ptr - buffer);
-			need = IKCP_OVERHEAD + segment->len;
-
-			if (size + need > (int)kcp->mtu) {
-				ikcp_output(kcp, buffer, size);
-				ptr = buffer;
+		// first transmit of segments moved from snd_queue
+		for (p = last->next; p != &kcp->snd_buf; p = p->next) {
+			IKCPSEG *segment = iqueue_entry(p, IKCPSEG, node);
+			segment->xmit++;
+			segment->rto = kcp->rx_rto;
+			segment->resendts = current + segment->rto + rtomin;
+			ikcp_heap_push(kcp, segment);
+			ptr = ikcp_flush_segment(kcp, segment, ptr, seg.wnd);
+		}
+	}	else {
+		for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
+			IKCPSEG *segment = iqueue_entry(p, IKCPSEG, node);
+			int needsend = 0;
+			if (segment->xmit == 0) {
+				needsend = 1;
+				segment->xmit++;
+				segment->rto = kcp->rx_rto;
+				segment->resendts = current + segment->rto + rtomin;
 			}
-
-			ptr = ikcp_encode_seg(ptr, segment);
-
-			if (segment->len > 0) {
-				memcpy(ptr, segment->data, segment->len);
-				ptr += segment->len;
+			else if (_itimediff(current, segment->resendts) >= 0) {
+				needsend = 1;
+				segment->xmit++;
+				kcp->xmit++;
+				if (kcp->nodelay == 0) {
+					segment->rto += _imax_(segment->rto, (IUINT32)kcp->rx_rto);
+				}	else {
+					IINT32 step = (kcp->nodelay < 2)? 
+						((IINT32)(segment->rto)) : kcp->rx_rto;
+					segment->rto += step / 2;
+				}
+				segment->resendts = current + segment->rto;
+				lost = 1;
+			}
+			else if (segment->fastack >= resent) {
+				if ((int)segment->xmit <= kcp->fastlimit || 
+					kcp->fastlimit <= 0) {
+					needsend = 1;
+					segment->xmit++;
+					segment->fastack = 0;
+					segment->resendts = current + segment->rto;
+					change++;
+				}
 			}
 
-			if (segment->xmit >= kcp->dead_link) {
-				kcp->state = (IUINT32)-1;
+			if (needsend) {
+				ptr = ikcp_flush_segment(kcp, segment, ptr, seg.wnd);
 			}
 		}
 	}
@@ -1120,8 +1608,13 @@ void ikcp_flush(ikcpcb *kcp)
 		ikcp_output(kcp, buffer, size);
 	}
 
+	if (kcp->cc && kcp->cc->on_loss) {
+		if (change) kcp->cc->on_loss(kcp, kcp->cc->user, 0);
+		if (lost) kcp->cc->on_loss(kcp, kcp->cc->user, 1);
+	}
+
 	// update ssthresh
-	if (change) {
+	if (change && kcp->cc == NULL) {
 		IUINT32 inflight = kcp->snd_nxt - kcp->snd_una;
 		kcp->ssthresh = inflight / 2;
 		if (kcp->ssthresh < IKCP_THRESH_MIN)
@@ -1130,7 +1623,7 @@ void ikcp_flush(ikcpcb *kcp)
 		kcp->incr = kcp->cwnd * kcp->mss;
 	}
 
-	if (lost) {
+	if (lost && kcp->cc == NULL) {
 		kcp->ssthresh = cwnd / 2;
 		if (kcp->ssthresh < IKCP_THRESH_MIN)
 			kcp->ssthresh = IKCP_THRESH_MIN;
@@ -1210,13 +1703,22 @@ IUINT32 ikcp_check(const ikcpcb *kcp, IUINT32 current)
 
 	tm_flush = _itimediff(ts_flush, current);
 
-	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
-		const IKCPSEG *seg = iqueue_entry(p, const IKCPSEG, node);
-		IINT32 diff = _itimediff(seg->resendts, current);
-		if (diff <= 0) {
-			return current;
+	if (kcp->snd_heap) {
+		if (kcp->snd_heap_size > 0) {
+			tm_packet = _itimediff(kcp->snd_heap[0]->resendts, current);
+			if (tm_packet <= 0) {
+				return current;
+			}
+		}
+	}	else {
+		for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
+			const IKCPSEG *seg = iqueue_entry(p, const IKCPSEG, node);
+			IINT32 diff = _itimediff(seg->resendts, current);
+			if (diff <= 0) {
+				return current;
+			}
+			if (diff < tm_packet) tm_packet = diff;
 		}
-		if (diff < tm_packet) tm_packet = diff;
 	}
 
 	minimal = (IUINT32)(tm_packet < tm_flush ? tm_packet : tm_flush);
@@ -1232,7 +1734,7 @@ int ikcp_setmtu(ikcpcb *kcp, int mtu)
 	char *buffer;
 	if (mtu < 50 || mtu < (int)IKCP_OVERHEAD) 
 		return -1;
-	buffer = (char*)ikcp_malloc((mtu + IKCP_OVERHEAD) * 3);
+	buffer = (char*)ikcp_malloc(kcp->reserved + (mtu + IKCP_OVERHEAD) * 3);
 	if (buffer == NULL) 
 		return -2;
 	kcp->mtu = mtu;
@@ -1242,6 +1744,20 @@ int ikcp_setmtu(ikcpcb *kcp, int mtu)
 	return 0;
 }
 
+int ikcp_reserve(ikcpcb *kcp, int reserved)
+{
+	char *buffer;
+	if (reserved < 0) 
+		return -1;
+	buffer = (char*)ikcp_malloc(reserved + (kcp->mtu + IKCP_OVERHEAD) * 3);
+	if (buffer == NULL) 
+		return -2;
+	kcp->reserved = (IUINT32)reserved;
+	ikcp_free(kcp->buffer);
+	kcp->buffer = buffer;
+	return 0;
+}
+
 int ikcp_interval(ikcpcb *kcp, int interval)
 {
 	if (interval > 5000) interval = 5000;
@@ -1283,7 +1799,11 @@ int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd)
 			kcp->snd_wnd = sndwnd;
 		}
 		if (rcvwnd > 0) {   // must >= max fragment size
-			kcp->rcv_wnd = _imax_(rcvwnd, IKCP_WND_RCV);
+			IUINT32 wnd = _imax_(rcvwnd, IKCP_WND_RCV);
+			if (kcp->rcv_ring && ikcp_ring_resize(kcp, wnd) != 0) {
+				return -1;
+			}
+			kcp->rcv_wnd = wnd;
 		}
 	}
 	return 0;
@@ -1294,6 +1814,14 @@ int ikcp_waitsnd(const ikcpcb *kcp)
 	return kcp->nsnd_buf + kcp->nsnd_que;
 }
 
+void ikcp_setcc(ikcpcb *kcp, const IKCPCC *cc)
+{
+	kcp->cc = cc;
+	if (kcp->cwnd < 1) {
+		kcp->cwnd = 1;
+	}
+}
+
 
 // read conv
 IUINT32 ikcp_getconv(const void *ptr)
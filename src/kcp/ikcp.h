@@ -279,10 +279,47 @@ struct IKCPSEG
 	IUINT32 rto;
 	IUINT32 fastack;
 	IUINT32 xmit;
+	IUINT32 heap;
+	struct IQUEUEHEAD fastnode;
 	char data[1];
 };
 
 
+//---------------------------------------------------------------------
+// IKCPCC: congestion control hooks, replace the builtin cwnd logic.
+// callbacks may be NULL and should set kcp->cwnd, which limits
+// ikcp_flush even if nocwnd is set
+//---------------------------------------------------------------------
+struct IKCPCB;
+
+struct IKCPCC
+{
+	// a data segment is sent, xmit is 1 for the first transmit
+	void (*on_send)(struct IKCPCB *kcp, void *user, IUINT32 sn, IUINT32 xmit);
+	// segments removed from snd_buf by an input
+	void (*on_ack)(struct IKCPCB *kcp, void *user, IUINT32 acked);
+	// loss found by ikcp_flush, timeout is 1 for rto, 0 for fast resend
+	void (*on_loss)(struct IKCPCB *kcp, void *user, int timeout);
+	// a rtt sample in millisec
+	void (*on_rtt)(struct IKCPCB *kcp, void *user, IINT32 rtt);
+	void *user;
+};
+
+typedef struct IKCPCC IKCPCC;
+
+
+//---------------------------------------------------------------------
+// IKCPVEC, a piece of a packet given to the vectored output
+//---------------------------------------------------------------------
+struct IKCPVEC
+{
+	const char *data;
+	int len;
+};
+
+typedef struct IKCPVEC IKCPVEC;
+
+
 //---------------------------------------------------------------------
 // IKCPCB
 //---------------------------------------------------------------------
@@ -303,16 +340,26 @@ struct IKCPCB
 	struct IQUEUEHEAD rcv_queue;
 	struct IQUEUEHEAD snd_buf;
 	struct IQUEUEHEAD rcv_buf;
+	struct IKCPSEG **rcv_ring;
+	IUINT32 rcv_ring_size;
+	struct IKCPSEG **snd_heap;
+	IUINT32 snd_heap_size, snd_heap_cap;
+	struct IQUEUEHEAD snd_fast;
 	IUINT32 *acklist;
 	IUINT32 ackcount;
 	IUINT32 ackblock;
 	void *user;
 	char *buffer;
+	IUINT32 reserved;
 	int fastresend;
 	int fastlimit;
 	int nocwnd, stream;
+	int sack;
+	const IKCPCC *cc;
 	int logmask;
 	int (*output)(const char *buf, int len, struct IKCPCB *kcp, void *user);
+	int (*outputv)(const IKCPVEC *vec, int count, struct IKCPCB *kcp, 
+		void *user);
 	void (*writelog)(const char *log, struct IKCPCB *kcp, void *user);
 };
 
@@ -332,6 +379,11 @@ typedef struct IKCPCB ikcpcb;
 #define IKCP_LOG_OUT_PROBE		1024
 #define IKCP_LOG_OUT_WINS		2048
 
+// flags of ikcp_create_ex
+#define IKCP_FLAG_RCV_RING		1	// keep rcv_buf in a ring indexed by sn
+#define IKCP_FLAG_SND_HEAP		2	// index snd_buf by resend time
+#define IKCP_FLAG_SACK			4	// ack with sn ranges, peer must support
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -345,6 +397,16 @@ extern "C" {
 // output callback can be setup like this: 'kcp->output = my_udp_output'
 ikcpcb* ikcp_create(IUINT32 conv, void *user);
 
+// create with IKCP_FLAG_* flags. IKCP_FLAG_RCV_RING stores out of order 
+// segments in a ring of at least rcv_wnd slots indexed by sn, inserting
+// and finding duplicates are O(1) instead of walking the rcv_buf list.
+// IKCP_FLAG_SND_HEAP keeps snd_buf in a min-heap of resendts and fast
+// retransmit candidates in a list, ikcp_flush only touches segments due.
+// IKCP_FLAG_SACK sends acknowledges as IKCP_CMD_SACK segments carrying
+// sorted [start, end) sn ranges and the newest ts, instead of one 
+// IKCP_CMD_ACK per segment. IKCP_CMD_SACK is always accepted by input
+ikcpcb* ikcp_create_ex(IUINT32 conv, void *user, int flags);
+
 // release kcp control object
 void ikcp_release(ikcpcb *kcp);
 
@@ -352,9 +414,31 @@ void ikcp_release(ikcpcb *kcp);
 void ikcp_setoutput(ikcpcb *kcp, int (*output)(const char *buf, int len, 
 	ikcpcb *kcp, void *user));
 
+// set vectored output callback, NULL to disable. a data segment of at 
+// least mss/2 bytes is not copied into the output buffer but given as 
+// the last piece after the buffer, ending the packet. other packets still
+// go to the output callback
+void ikcp_setoutputv(ikcpcb *kcp, int (*outputv)(const IKCPVEC *vec, 
+	int count, ikcpcb *kcp, void *user));
+
+// reserve bytes in front of the output buffer, the output callbacks may 
+// write a header of at most 'reserved' bytes right before 'buf' or the 
+// first piece, returns below zero for error
+int ikcp_reserve(ikcpcb *kcp, int reserved);
+
 // user/upper level recv: returns size, returns below zero for EAGAIN
 int ikcp_recv(ikcpcb *kcp, char *buffer, int len);
 
+// recv in place: detach the segments of the next message and return the
+// first one, NULL for EAGAIN. 'len' is set to the size of message.
+// segments are chained by node.next in order and the last one points to 
+// NULL, they belong to the caller until ikcp_recv_release, which does not
+// need kcp alive
+struct IKCPSEG *ikcp_recv_segments(ikcpcb *kcp, int *len);
+
+// free segments returned by ikcp_recv_segments
+void ikcp_recv_release(struct IKCPSEG *seg);
+
 // user/upper level send, returns below zero for error
 int ikcp_send(ikcpcb *kcp, const char *buffer, int len);
 
@@ -390,6 +474,10 @@ int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd);
 // get how many packet is waiting to be sent
 int ikcp_waitsnd(const ikcpcb *kcp);
 
+// set congestion control hooks, NULL for the builtin one. 'cc' must 
+// outlive kcp or be reset
+void ikcp_setcc(ikcpcb *kcp, const IKCPCC *cc);
+
 // fastest: ikcp_nodelay(kcp, 1, 20, 2, 1)
 // nodelay: 0:disable(default), 1:enable
 // interval: internal update timer interval in millisec, default is 100ms 
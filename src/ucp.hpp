@@ -3,6 +3,17 @@
 
 #include "ucpbase.hpp"
 #include "ucpclient.hpp"
+#include "ucpconfig.hpp"
+#include "ucpcongestion.hpp"
+#include "ucpexecutor.hpp"
+#include "ucphandler.hpp"
+#include "ucploop.hpp"
+#include "ucppool.hpp"
 #include "ucpserver.hpp"
+#include "ucpview.hpp"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include "ucpasync.hpp"
+#endif
 
 #endif // UCP_SRC_UCP_HPP_
\ No newline at end of file
@@ -0,0 +1,258 @@
+#ifndef UCP_SRC_UCPASYNC_HPP_
+#define UCP_SRC_UCPASYNC_HPP_
+
+// coroutines need c++20, the rest of ucp builds with c++17
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "ucpasync.hpp needs c++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <sys/types.h>
+
+#include "ucpbase.hpp"
+#include "ucploop.hpp"
+#include "ucpserver.hpp"
+
+namespace ucp {
+
+/**
+ * @brief a coroutine which starts at once and frees itself when it returns,
+ * nobody waits for it. an exception escaping it terminates
+ *
+ */
+struct Task {
+	struct promise_type {
+		Task get_return_object() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void() noexcept
+		{
+		}
+
+		void unhandled_exception() noexcept
+		{
+			std::terminate();
+		}
+	};
+};
+
+/**
+ * @brief resume handle on loop, called by the network threads
+ *
+ */
+inline std::function<void()> resume_on(EventLoop &loop,
+									   std::coroutine_handle<> handle)
+{
+	return [&loop, handle] { loop.post([handle] { handle.resume(); }); };
+}
+
+template <class T>
+class AcceptAwaiter {
+public:
+	AcceptAwaiter(EventLoop &loop, Server<T> &server)
+		: loop_(loop)
+		, server_(server)
+	{
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		// resumed by the loop after session_ is set
+		EventLoop *loop = &loop_;
+		server_.async_accept([this, loop, handle](
+			std::shared_ptr<Session> session) {
+			session_ = session;
+			loop->post([handle] { handle.resume(); });
+		});
+	}
+
+	std::shared_ptr<Session> await_resume()
+	{
+		return session_;
+	}
+
+private:
+	EventLoop &loop_;
+	Server<T> &server_;
+	std::shared_ptr<Session> session_;
+};
+
+class RecvAwaiter {
+public:
+	RecvAwaiter(EventLoop &loop, Session &session, void *data, size_t size)
+		: loop_(loop)
+		, session_(session)
+		, data_(data)
+		, size_(size)
+		, result_(0)
+	{
+	}
+
+	bool await_ready()
+	{
+		result_ = session_.recv(data_, size_);
+		return result_ != 0;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		return session_.when_readable(resume_on(loop_, handle));
+	}
+
+	ssize_t await_resume()
+	{
+		if (result_ == 0) {
+			result_ = session_.recv(data_, size_);
+		}
+
+		return result_;
+	}
+
+private:
+	EventLoop &loop_;
+	Session &session_;
+	void *data_;
+	size_t size_;
+	ssize_t result_;
+};
+
+class RecvViewAwaiter {
+public:
+	RecvViewAwaiter(EventLoop &loop, Session &session, MessageView &view)
+		: loop_(loop)
+		, session_(session)
+		, view_(view)
+		, result_(0)
+	{
+	}
+
+	bool await_ready()
+	{
+		result_ = session_.recv_view(view_);
+		return result_ != 0;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		return session_.when_readable(resume_on(loop_, handle));
+	}
+
+	ssize_t await_resume()
+	{
+		if (result_ == 0) {
+			result_ = session_.recv_view(view_);
+		}
+
+		return result_;
+	}
+
+private:
+	EventLoop &loop_;
+	Session &session_;
+	MessageView &view_;
+	ssize_t result_;
+};
+
+class SendAwaiter {
+public:
+	SendAwaiter(EventLoop &loop, Session &session, const void *data,
+				size_t size)
+		: loop_(loop)
+		, session_(session)
+		, data_(data)
+		, size_(size)
+	{
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	// suspend only while the send buffer is full
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		return session_.when_writable(resume_on(loop_, handle));
+	}
+
+	ssize_t await_resume()
+	{
+		return session_.send(data_, size_);
+	}
+
+private:
+	EventLoop &loop_;
+	Session &session_;
+	const void *data_;
+	size_t size_;
+};
+
+/**
+ * @brief accept a new connection, the coroutine is resumed on loop
+ *
+ * @return std::shared_ptr<Session> by co_await, nullptr if the server exits
+ */
+template <class T>
+AcceptAwaiter<T> async_accept(EventLoop &loop, Server<T> &server)
+{
+	return AcceptAwaiter<T>(loop, server);
+}
+
+/**
+ * @brief recv data, suspending until a message arrives. the coroutine is
+ * resumed on loop, which must outlive the session
+ *
+ * @return ssize_t by co_await, size of data received, -1 if error or closed,
+ * 0 only if another reader took the message
+ */
+inline RecvAwaiter async_recv(EventLoop &loop, Session &session, void *data,
+							  size_t size)
+{
+	return RecvAwaiter(loop, session, data, size);
+}
+
+/**
+ * @brief recv the next message in place, see async_recv and
+ * Session::recv_view
+ *
+ */
+inline RecvViewAwaiter async_recv_view(EventLoop &loop, Session &session,
+									   MessageView &view)
+{
+	return RecvViewAwaiter(loop, session, view);
+}
+
+/**
+ * @brief send data, suspending while the send buffer is full, see async_recv
+ *
+ * @return ssize_t by co_await, size of data sent, -1 if error
+ */
+inline SendAwaiter async_send(EventLoop &loop, Session &session,
+							  const void *data, size_t size)
+{
+	return SendAwaiter(loop, session, data, size);
+}
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPASYNC_HPP_
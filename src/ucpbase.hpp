@@ -2,12 +2,22 @@
 #define UCP_SRC_UCPBASE_HPP_
 
 #include "kcp/ikcp.h"
+#include "ucpendpoint.hpp"
+#include "ucpview.hpp"
 
 #include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 namespace ucp {
 
@@ -18,6 +28,8 @@ enum MessageType : uint8_t {
 	kTypeCloseSession,
 	kTypeData,
 	kHeartbeat,
+	kTypePathChallenge,
+	kTypePathResponse,
 };
 
 enum Status {
@@ -29,18 +41,64 @@ enum Status {
 	kExit,
 };
 
+/*
+ * wire format, all fields are little-endian and packed:
+ *
+ * +----------+----------------+--------------+------------------+
+ * | type(1B) | session_id(4B) | msg_size(4B) | msg_data(msg_size) |
+ * +----------+----------------+--------------+------------------+
+ */
+constexpr size_t kUCPHeaderSize = 1 + 4 + 4;
+
+constexpr size_t kUCPMaxPacketSize = kUCPHeaderSize + 1024;
+
+constexpr size_t kUCPMaxDataSize = kUCPMaxPacketSize - kUCPHeaderSize;
+
+// mtu of kcp, a full kcp segment must fit in msg_data
+constexpr size_t kUCPKcpMtu = kUCPMaxDataSize;
+
 struct Message {
 	MessageType msg_type;
 	uint32_t session_id;
 	uint32_t msg_size;
-	char msg_data[1024];
+	char msg_data[kUCPMaxDataSize];
 };
 
-constexpr size_t kUCPMessageSize = sizeof(Message);
+/*
+ * optional features, the client offers a bit set in the payload of
+ * kTypeNewSession and the server answers the agreed subset in the payload of
+ * kTypeAcceptSession, 4 bytes little-endian. no payload means no feature.
+ * the config of the session follows, see encode_config
+ */
+enum Feature : uint32_t {
+	kFeatureSack = 1u << 0, // acknowledge with sn ranges
+};
+
+constexpr uint32_t kUCPSupportedFeatures = kFeatureSack;
+
+// max number of packets in one batch of Sock::recv_batch/send_batch
+constexpr size_t kUCPBatchSize = 64;
+
+// a raw packet on the wire
+struct Packet {
+	char data[kUCPMaxPacketSize];
+	size_t size;
+	Endpoint address;
+};
 
 constexpr std::chrono::milliseconds kUCPDefaultInterval =
 	std::chrono::milliseconds(10);
 
+// max packets read from socket in one tick, 0 for no limit
+constexpr size_t kUCPDefaultIngestBudget = 4096;
+
+// max sessions waiting for accept, new sessions are rejected beyond it
+constexpr size_t kUCPDefaultAcceptBacklog = 1024;
+
+// wait without timeout
+constexpr std::chrono::milliseconds kUCPNoTimeout =
+	std::chrono::milliseconds::max();
+
 constexpr std::chrono::milliseconds kUCPDefaultHeartbeatTimeout =
 	std::chrono::milliseconds(30000);
 
@@ -50,6 +108,20 @@ constexpr std::chrono::milliseconds kUCPDefaultHeartbeatInterval =
 constexpr std::chrono::milliseconds kUCPDefaultHandshakeTimeout =
 	std::chrono::milliseconds(3000);
 
+// min interval between path challenges of a session, whatever the paths
+constexpr std::chrono::milliseconds kUCPDefaultPathChallengeInterval =
+	std::chrono::milliseconds(100);
+
+// size of the token in path challenge and response
+constexpr size_t kUCPPathTokenSize = 8;
+
+// a path token is valid until the end of the next bucket of this length
+constexpr std::chrono::milliseconds kUCPPathTokenLifetime =
+	std::chrono::milliseconds(1000);
+
+// a blocking send waits while kcp holds this many windows of unacked data
+constexpr uint32_t kUCPSendBufferWindows = 2;
+
 class Session {
 public:
 	virtual ~Session()
@@ -59,6 +131,54 @@ public:
 	virtual ssize_t send(const void *data, size_t size) = 0;
 
 	virtual ssize_t recv(void *data, size_t size) = 0;
+
+	/**
+	 * @brief send data, waiting while the send buffer of the session is full
+	 * 
+	 * @param timeout kUCPNoTimeout to wait without timeout
+	 * @return ssize_t size of data sent, -1 if error, 0 if timed out
+	 */
+	virtual ssize_t send(const void *data, size_t size,
+						 std::chrono::milliseconds timeout) = 0;
+
+	/**
+	 * @brief recv data, waiting until a message arrives
+	 * 
+	 * @param timeout kUCPNoTimeout to wait without timeout
+	 * @return ssize_t size of data received, -1 if error or closed, 0 if
+	 * timed out
+	 */
+	virtual ssize_t recv(void *data, size_t size,
+						 std::chrono::milliseconds timeout) = 0;
+
+	/**
+	 * @brief recv the next message in place, without copying it out
+	 * 
+	 * @param view set to the message, the caller releases it
+	 * @return ssize_t size of message, -1 if error, 0 with an empty view if
+	 * no data
+	 */
+	virtual ssize_t recv_view(MessageView &view) = 0;
+
+	/**
+	 * @brief call callback once when recv stops returning 0, i.e. a message
+	 * arrived or the session is closed. it runs in a network thread, or the
+	 * thread closing the session, without the session locked
+	 * 
+	 * @return true 
+	 * @return false if recv does not return 0 already, callback is dropped
+	 */
+	virtual bool when_readable(std::function<void()> callback) = 0;
+
+	/**
+	 * @brief call callback once when a blocking send would not wait, i.e. the
+	 * send buffer drained or the session is closed, see when_readable
+	 * 
+	 * @return true 
+	 * @return false if send would not wait already, callback is dropped
+	 */
+	virtual bool when_writable(std::function<void()> callback) = 0;
+
 	virtual void close() = 0;
 
 	/**
@@ -69,6 +189,31 @@ public:
 	virtual std::string address() = 0;
 };
 
+/**
+ * @brief copy pieces of a packet into one buffer
+ * 
+ * @param iov pieces
+ * @param iovcnt number of pieces
+ * @param buf buffer to store the packet
+ * @param size size of buffer
+ * @return size_t size of packet, 0 if it does not fit
+ */
+inline size_t gather_iovec(const struct iovec *iov, size_t iovcnt, char *buf,
+						   size_t size)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > size - total) {
+			return 0;
+		}
+
+		memcpy(buf + total, iov[i].iov_base, iov[i].iov_len);
+		total += iov[i].iov_len;
+	}
+
+	return total;
+}
+
 class Sock {
 public:
 	virtual ~Sock() = default;
@@ -90,25 +235,143 @@ public:
 	virtual std::string address() = 0;
 
 	/**
-	 * @brief send a packet to address
+	 * @brief convert address to endpoint, default parses "ip:port"
+	 * 
+	 * @param address address passed to bind or connect
+	 * @param endpoint 
+	 * @return true 
+	 * @return false if address is invalid
+	 */
+	virtual bool resolve(const std::string &address, Endpoint &endpoint)
+	{
+		return endpoint.parse(address);
+	}
+
+	/**
+	 * @brief send a packet to endpoint
 	 * 
 	 * @param data data to send
 	 * @param size size of data
-	 * @param to target address 
+	 * @param to target endpoint 
 	 * @return ssize_t size of data sent, -1 if error
 	 */
 	virtual ssize_t send_to(const void *data, size_t size,
-							const std::string &to) = 0;
+							const Endpoint &to) = 0;
+
+	/**
+	 * @brief send a packet gathered from pieces, default implementation
+	 * copies them into one buffer and calls send_to
+	 * 
+	 * @param iov pieces of the packet
+	 * @param iovcnt number of pieces
+	 * @param to target endpoint
+	 * @return ssize_t size of data sent, -1 if error
+	 */
+	virtual ssize_t send_to(const struct iovec *iov, size_t iovcnt,
+							const Endpoint &to)
+	{
+		char buf[kUCPMaxPacketSize];
+		size_t size = gather_iovec(iov, iovcnt, buf, sizeof(buf));
+		if (size == 0) {
+			return -1;
+		}
+
+		return send_to(buf, size, to);
+	}
 
 	/**
 	 * @brief recv a packet
 	 * 
 	 * @param data buffer to store data
 	 * @param size size of buffer
-	 * @param from source address
+	 * @param from source endpoint
 	 * @return ssize_t size of data received, -1 if error, 0 if no data
 	 */
-	virtual ssize_t recv_from(void *data, size_t size, std::string &from) = 0;
+	virtual ssize_t recv_from(void *data, size_t size, Endpoint &from) = 0;
+
+	/**
+	 * @brief send a batch of packets, default implementation calls send_to
+	 * for each packet
+	 * 
+	 * @param packets packets to send
+	 * @param count number of packets
+	 * @return ssize_t number of packets sent, -1 if error on the first packet
+	 */
+	virtual ssize_t send_batch(const Packet *packets, size_t count)
+	{
+		for (size_t i = 0; i < count; i++) {
+			if (send_to(packets[i].data, packets[i].size,
+						packets[i].address) < 0) {
+				return i > 0 ? (ssize_t)i : -1;
+			}
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief recv a batch of packets, default implementation calls recv_from
+	 * until no data
+	 * 
+	 * @param packets buffer to store packets, size of each packet is set
+	 * @param count max number of packets
+	 * @return ssize_t number of packets received, -1 if error, 0 if no data
+	 */
+	virtual ssize_t recv_batch(Packet *packets, size_t count)
+	{
+		for (size_t i = 0; i < count; i++) {
+			ssize_t ret = recv_from(packets[i].data, sizeof(packets[i].data),
+									packets[i].address);
+			if (ret < 0) {
+				return i > 0 ? (ssize_t)i : -1;
+			}
+
+			if (ret == 0) {
+				return i;
+			}
+
+			packets[i].size = ret;
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief allow several socks to bind the same address, the kernel spreads
+	 * received packets across them, must be called before bind
+	 * 
+	 * @return true 
+	 * @return false if not supported
+	 */
+	virtual bool reuse_port()
+	{
+		return false;
+	}
+
+	/**
+	 * @brief steer packets across the socks bound to the same address by
+	 * session id, the i-th bound sock receives sessions with
+	 * session_id % count == i, must be called after bind
+	 * 
+	 * @param count number of socks bound to the address
+	 * @return true 
+	 * @return false if not supported
+	 */
+	virtual bool steer_by_session(size_t /*count*/)
+	{
+		return false;
+	}
+
+	/**
+	 * @brief get file descriptor to wait for readable
+	 * 
+	 * @return int -1 if not supported, the socket is polled every
+	 * kUCPDefaultInterval instead
+	 */
+	virtual int fd()
+	{
+		return -1;
+	}
 
 	/**
 	 * @brief close socket
@@ -117,7 +380,513 @@ public:
 	virtual void close() = 0;
 };
 
-static IUINT32 iclock()
+/**
+ * @brief encode header into wire format
+ * 
+ * @param buf buffer with at least kUCPHeaderSize bytes
+ * @return size_t size of header
+ */
+inline size_t encode_header(char *buf, MessageType msg_type,
+							uint32_t session_id, uint32_t msg_size)
+{
+	buf[0] = (char)msg_type;
+	for (int i = 0; i < 4; i++) {
+		buf[1 + i] = (char)((session_id >> (i * 8)) & 0xff);
+		buf[5 + i] = (char)((msg_size >> (i * 8)) & 0xff);
+	}
+
+	return kUCPHeaderSize;
+}
+
+/**
+ * @brief encode the header of a data message into the headroom before a kcp
+ * packet, kcp must reserve kUCPHeaderSize bytes by ikcp_reserve
+ * 
+ * @param vec pieces of the kcp packet, from outputv or the buffer of output
+ * @param count number of pieces
+ * @param iov set to count pieces of the wire packet, the header joins the
+ * first piece
+ * @return size_t size of the wire packet
+ */
+inline size_t encode_kcp_packet(uint32_t session_id, const IKCPVEC *vec,
+								int count, struct iovec *iov)
+{
+	size_t size = 0;
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = (void *)vec[i].data;
+		iov[i].iov_len = vec[i].len;
+		size += vec[i].len;
+	}
+
+	char *header = (char *)vec[0].data - kUCPHeaderSize;
+	encode_header(header, kTypeData, session_id, size);
+	iov[0].iov_base = header;
+	iov[0].iov_len += kUCPHeaderSize;
+	return kUCPHeaderSize + size;
+}
+
+/**
+ * @brief encode message into wire format, only msg_size bytes of msg_data
+ * are written
+ * 
+ * @param msg message to encode
+ * @param buf buffer with at least kUCPMaxPacketSize bytes
+ * @return size_t size of packet, 0 if msg_size is too large
+ */
+inline size_t encode_message(const Message &msg, char *buf)
+{
+	if (msg.msg_size > kUCPMaxDataSize) {
+		return 0;
+	}
+
+	encode_header(buf, msg.msg_type, msg.session_id, msg.msg_size);
+	memcpy(buf + kUCPHeaderSize, msg.msg_data, msg.msg_size);
+	return kUCPHeaderSize + msg.msg_size;
+}
+
+/**
+ * @brief decode header of a packet received from wire, payload is not copied
+ * 
+ * @param buf packet data
+ * @param size size of packet
+ * @param msg msg_type, session_id and msg_size are set
+ * @return true 
+ * @return false if packet is malformed
+ */
+inline bool decode_header(const char *buf, size_t size, Message &msg)
+{
+	if (size < kUCPHeaderSize) {
+		return false;
+	}
+
+	const unsigned char *p = (const unsigned char *)buf;
+	uint32_t session_id = 0;
+	uint32_t msg_size = 0;
+	for (int i = 0; i < 4; i++) {
+		session_id |= (uint32_t)p[1 + i] << (i * 8);
+		msg_size |= (uint32_t)p[5 + i] << (i * 8);
+	}
+
+	if (msg_size > kUCPMaxDataSize || size != kUCPHeaderSize + msg_size) {
+		return false;
+	}
+
+	msg.msg_type = (MessageType)p[0];
+	msg.session_id = session_id;
+	msg.msg_size = msg_size;
+	return true;
+}
+
+/**
+ * @brief decode a packet received from wire
+ * 
+ * @param buf packet data
+ * @param size size of packet
+ * @param msg decoded message
+ * @return true 
+ * @return false if packet is malformed
+ */
+inline bool decode_message(const char *buf, size_t size, Message &msg)
+{
+	if (!decode_header(buf, size, msg)) {
+		return false;
+	}
+
+	memcpy(msg.msg_data, buf + kUCPHeaderSize, msg.msg_size);
+	return true;
+}
+
+/**
+ * @brief set features as payload of a handshake message
+ * 
+ */
+inline void encode_features(Message &msg, uint32_t features)
+{
+	for (int i = 0; i < 4; i++) {
+		msg.msg_data[i] = (char)((features >> (i * 8)) & 0xff);
+	}
+	msg.msg_size = 4;
+}
+
+/**
+ * @brief get features from payload of a handshake message
+ * 
+ * @return uint32_t 0 if no payload
+ */
+inline uint32_t decode_features(const Message &msg)
+{
+	if (msg.msg_size < 4) {
+		return 0;
+	}
+
+	const unsigned char *p = (const unsigned char *)msg.msg_data;
+	uint32_t features = 0;
+	for (int i = 0; i < 4; i++) {
+		features |= (uint32_t)p[i] << (i * 8);
+	}
+
+	return features;
+}
+
+/**
+ * @brief get flags of ikcp_create_ex for the negotiated features
+ * 
+ */
+inline int kcp_create_flags(uint32_t features)
+{
+	int flags = IKCP_FLAG_RCV_RING | IKCP_FLAG_SND_HEAP;
+	if (features & kFeatureSack) {
+		flags |= IKCP_FLAG_SACK;
+	}
+
+	return flags;
+}
+
+/**
+ * @brief encode message and send it to endpoint
+ * 
+ * @return ssize_t size of data sent, -1 if error
+ */
+inline ssize_t send_message(Sock *sock, const Message &msg,
+							const Endpoint &to)
+{
+	if (msg.msg_size > kUCPMaxDataSize) {
+		return -1;
+	}
+
+	char header[kUCPHeaderSize];
+	encode_header(header, msg.msg_type, msg.session_id, msg.msg_size);
+
+	struct iovec iov[2];
+	iov[0].iov_base = header;
+	iov[0].iov_len = kUCPHeaderSize;
+	iov[1].iov_base = (void *)msg.msg_data;
+	iov[1].iov_len = msg.msg_size;
+	return sock->send_to(iov, 2, to);
+}
+
+/**
+ * @brief recv a packet and decode it
+ * 
+ * @return ssize_t size of packet, -1 if error, 0 if no data, -2 if the packet
+ * is malformed
+ */
+inline ssize_t recv_message(Sock *sock, Message &msg, Endpoint &from)
+{
+	char buf[kUCPMaxPacketSize];
+	ssize_t ret = sock->recv_from(buf, sizeof(buf), from);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	if (!decode_message(buf, ret, msg)) {
+		return -2;
+	}
+
+	return ret;
+}
+
+/**
+ * @brief number of packets to read in the next recv_batch
+ * 
+ * @param received packets already read in this tick
+ * @param budget max packets to read in this tick, 0 for no limit
+ * @return size_t 0 if budget is exhausted
+ */
+inline size_t ingest_batch_size(size_t received, size_t budget)
+{
+	if (budget == 0) {
+		return kUCPBatchSize;
+	}
+
+	if (received >= budget) {
+		return 0;
+	}
+
+	return budget - received < kUCPBatchSize ? budget - received
+											 : kUCPBatchSize;
+}
+
+/**
+ * @brief queue of packets to send, packets are sent in batch when flushed
+ * 
+ */
+class SendQueue {
+public:
+	SendQueue(std::shared_ptr<Sock> sock)
+		: sock_(sock)
+		, packets_(kUCPBatchSize)
+		, size_(0)
+	{
+	}
+
+	/**
+	 * @brief encode a message and queue it, flush if queue is full
+	 * 
+	 * @return ssize_t size of packet, -1 if error
+	 */
+	ssize_t push(MessageType msg_type, uint32_t session_id, const void *data,
+				 size_t size, const Endpoint &to)
+	{
+		if (size > kUCPMaxDataSize) {
+			return -1;
+		}
+
+		if (size_ == packets_.size()) {
+			flush();
+		}
+
+		Packet &packet = packets_[size_++];
+		size_t header_size =
+			encode_header(packet.data, msg_type, session_id, size);
+		memcpy(packet.data + header_size, data, size);
+		packet.size = header_size + size;
+		packet.address = to;
+
+		return packet.size;
+	}
+
+	ssize_t push(const Message &msg, const Endpoint &to)
+	{
+		return push(msg.msg_type, msg.session_id, msg.msg_data, msg.msg_size,
+					to);
+	}
+
+	/**
+	 * @brief queue a packet in wire format gathered from pieces, flush if
+	 * queue is full
+	 * 
+	 * @return ssize_t size of packet, -1 if error
+	 */
+	ssize_t push(const struct iovec *iov, size_t iovcnt, const Endpoint &to)
+	{
+		if (size_ == packets_.size()) {
+			flush();
+		}
+
+		Packet &packet = packets_[size_];
+		packet.size = gather_iovec(iov, iovcnt, packet.data,
+								   sizeof(packet.data));
+		if (packet.size == 0) {
+			return -1;
+		}
+
+		packet.address = to;
+		size_++;
+		return packet.size;
+	}
+
+	/**
+	 * @brief send all queued packets, packets failed to send are dropped
+	 * 
+	 * @return size_t number of packets sent
+	 */
+	size_t flush()
+	{
+		size_t done = 0;
+		size_t sent = 0;
+		while (done < size_) {
+			ssize_t ret = sock_->send_batch(&packets_[done], size_ - done);
+			if (ret <= 0) { // drop the failed packet
+				done++;
+			} else {
+				done += ret;
+				sent += ret;
+			}
+		}
+
+		size_ = 0;
+		return sent;
+	}
+
+private:
+	std::shared_ptr<Sock> sock_;
+	std::vector<Packet> packets_;
+	size_t size_;
+};
+
+/**
+ * @brief get time until next ikcp_update is needed
+ * 
+ * @param kcp 
+ * @param current current time from iclock
+ * @return std::chrono::milliseconds kUCPNoTimeout if kcp has nothing to send
+ */
+inline std::chrono::milliseconds kcp_next_update(ikcpcb *kcp, IUINT32 current)
+{
+	if (ikcp_waitsnd(kcp) == 0 && kcp->ackcount == 0 && kcp->probe == 0 &&
+		kcp->rmt_wnd > 0) {
+		return kUCPNoTimeout;
+	}
+
+	return std::chrono::milliseconds(ikcp_check(kcp, current) - current);
+}
+
+/**
+ * @brief get time until deadline
+ * 
+ * @return std::chrono::milliseconds 0 if deadline has passed
+ */
+inline std::chrono::milliseconds
+time_until(std::chrono::steady_clock::time_point deadline,
+		   std::chrono::steady_clock::time_point now)
+{
+	if (deadline <= now) {
+		return std::chrono::milliseconds(0);
+	}
+
+	// round up, so deadline has passed when wake up
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			   deadline - now) +
+		   std::chrono::milliseconds(1);
+}
+
+/**
+ * @brief get deadline of a timeout
+ * 
+ * @param timeout kUCPNoTimeout for no deadline
+ * @return std::chrono::steady_clock::time_point max() if no deadline
+ */
+inline std::chrono::steady_clock::time_point
+deadline_after(std::chrono::milliseconds timeout)
+{
+	if (timeout == kUCPNoTimeout) {
+		return std::chrono::steady_clock::time_point::max();
+	}
+
+	return std::chrono::steady_clock::now() + timeout;
+}
+
+/**
+ * @brief wait on cv until pred holds or deadline passes
+ * 
+ * @param deadline from deadline_after
+ * @return true 
+ * @return false if deadline passed and pred does not hold
+ */
+template <typename Predicate>
+inline bool wait_until_deadline(std::condition_variable &cv,
+								std::unique_lock<std::mutex> &lock,
+								std::chrono::steady_clock::time_point deadline,
+								Predicate pred)
+{
+	if (deadline == std::chrono::steady_clock::time_point::max()) {
+		cv.wait(lock, pred);
+		return true;
+	}
+
+	return cv.wait_until(lock, deadline, pred);
+}
+
+/**
+ * @brief check if kcp has room for more data, blocking sends wait until it
+ * does, so the app stays at most kUCPSendBufferWindows windows ahead of acks
+ * 
+ */
+inline bool kcp_writable(const ikcpcb *kcp)
+{
+	return (uint32_t)ikcp_waitsnd(kcp) < kcp->snd_wnd * kUCPSendBufferWindows;
+}
+
+/**
+ * @brief one-shot callbacks of Session::when_readable and when_writable. they
+ * fire with the session locked and run after it is unlocked, so they may call
+ * the session
+ * 
+ */
+class SessionWatchers {
+public:
+	void readable(std::function<void()> callback)
+	{
+		readable_.push_back(std::move(callback));
+	}
+
+	void writable(std::function<void()> callback)
+	{
+		writable_.push_back(std::move(callback));
+	}
+
+	bool empty() const
+	{
+		return readable_.empty() && writable_.empty();
+	}
+
+	/**
+	 * @brief fire callbacks whose condition holds, called with the session
+	 * locked
+	 * 
+	 */
+	void fire(bool readable, bool writable)
+	{
+		if (readable) {
+			fire(readable_);
+		}
+
+		if (writable) {
+			fire(writable_);
+		}
+	}
+
+	/**
+	 * @brief run fired callbacks, the session is unlocked meanwhile
+	 * 
+	 * @param lock lock of the session, locked again on return
+	 */
+	void run(std::unique_lock<std::mutex> &lock)
+	{
+		if (fired_.empty()) {
+			return;
+		}
+
+		std::vector<std::function<void()> > fired;
+		fired.swap(fired_);
+
+		lock.unlock();
+		for (auto &callback : fired) {
+			callback();
+		}
+		lock.lock();
+	}
+
+	/**
+	 * @brief move fired callbacks to fired instead of running them, for a
+	 * caller holding more locks than the session's
+	 * 
+	 */
+	void take(std::vector<std::function<void()> > &fired)
+	{
+		for (auto &callback : fired_) {
+			fired.push_back(std::move(callback));
+		}
+		fired_.clear();
+	}
+
+private:
+	void fire(std::vector<std::function<void()> > &callbacks)
+	{
+		for (auto &callback : callbacks) {
+			fired_.push_back(std::move(callback));
+		}
+		callbacks.clear();
+	}
+
+	std::vector<std::function<void()> > readable_;
+	std::vector<std::function<void()> > writable_;
+	std::vector<std::function<void()> > fired_;
+};
+
+/**
+ * @brief get milliseconds of steady clock
+ * 
+ */
+inline uint64_t steady_clock_ms()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+inline IUINT32 iclock()
 {
 	auto now_unix = std::chrono::system_clock::now();
 	auto now_ms =
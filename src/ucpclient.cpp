@@ -1,6 +1,7 @@
 #include "ucpclient.hpp"
 
 #include "ucpbase.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <cstring>
@@ -10,15 +11,20 @@
 
 #include "kcp/ikcp.h"
 #include "ucp.hpp"
+#include "ucppool.hpp"
 
 using namespace ucp;
 
 void ClientInternel::monitor_thread_func(
 	std::shared_ptr<ClientInternel> internel)
 {
+	bool has_fd = internel->sock_->fd() != -1 &&
+				  internel->reactor_.add(internel->sock_->fd());
+
 	while (true) {
+		std::chrono::milliseconds timeout;
 		{
-			std::lock_guard<std::mutex> lock(internel->status_mutex_);
+			std::unique_lock<std::mutex> lock(internel->status_mutex_);
 
 			if (internel->status_ == kInit) {
 				internel->status_ = tranfer_status_from_init(internel);
@@ -31,12 +37,50 @@ void ClientInternel::monitor_thread_func(
 			} else if (internel->status_ == kExit) {
 				break;
 			}
+
+			internel->notify_waiters();
+			internel->send_queue_.flush();
+			timeout = next_timeout(internel);
+			internel->watchers_.run(lock);
 		}
 
-		std::this_thread::sleep_for(kUCPDefaultInterval);
+		if (!has_fd) { // can not wait for socket, poll it
+			timeout = std::min(timeout, kUCPDefaultInterval);
+		}
+
+		internel->reactor_.wait(timeout);
 	}
 }
 
+std::chrono::milliseconds
+ClientInternel::next_timeout(std::shared_ptr<ClientInternel> internel)
+{
+	if (internel->status_ == kClosed) { // keep telling remote until exit
+		return internel->config_.tick();
+	}
+
+	if (internel->status_ != kConnected) { // wait for socket or wakeup
+		return kUCPNoTimeout;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	auto timeout = std::min(
+		kcp_next_update(internel->kcp_, iclock()),
+		time_until(internel->last_hearbeat_time_ +
+					   internel->config_.heartbeat_timeout,
+				   now));
+	timeout = std::min(timeout, internel->pacer_.next_release());
+
+	auto heartbeat_time =
+		internel->last_hearbeat_time_ + internel->config_.heartbeat_interval;
+	if (heartbeat_time <= now) { // waiting for reply, resend every interval
+		heartbeat_time =
+			internel->last_hearbeat_send_time_ + internel->config_.tick();
+	}
+
+	return std::min(timeout, time_until(heartbeat_time, now));
+}
+
 Status ClientInternel::tranfer_status_from_init(
 	std::shared_ptr<ClientInternel> internel)
 {
@@ -47,8 +91,8 @@ Status ClientInternel::tranfer_status_from_handshake(
 	std::shared_ptr<ClientInternel> internel)
 {
 	Message msg;
-	std::string address;
-	ssize_t ret = internel->sock_->recv_from(&msg, sizeof(msg), address);
+	Endpoint from;
+	ssize_t ret = recv_message(internel->sock_.get(), msg, from);
 
 	if (ret == -1) {
 		return kExit;
@@ -58,21 +102,36 @@ Status ClientInternel::tranfer_status_from_handshake(
 		return kHandshake;
 	}
 
-	if (ret != sizeof(msg)) {
-		return kExit;
+	if (ret < 0) { // malformed packet, drop it
+		return kHandshake;
 	}
 
-	if (address != internel->remote_address_) {
-		return kExit;
+	if (from != internel->remote_endpoint_) {
+		return kHandshake; // not from the server, drop it
 	}
 
 	if (msg.msg_type == kTypeAcceptSession) {
 		internel->session_id_ = msg.session_id;
-		internel->kcp_ = ikcp_create(msg.session_id, internel.get());
+
+		Pool::install();
+		uint32_t features = decode_features(msg) & kUCPSupportedFeatures;
+		Config agreed;
+		if (decode_config(msg, agreed)) { // an old server answers nothing
+			internel->config_ = adopt_config(internel->config_, agreed);
+		}
+
+		internel->kcp_ = ikcp_create_ex(msg.session_id, internel.get(),
+										kcp_create_flags(features));
 		ikcp_setoutput(internel->kcp_, ucp_output);
-		ikcp_nodelay(internel->kcp_, 1, 10, 2, 1);
-		ikcp_wndsize(internel->kcp_, 128, 128);
-		ikcp_setmtu(internel->kcp_, kUCPMessageSize);
+		ikcp_setoutputv(internel->kcp_, ucp_outputv);
+		ikcp_reserve(internel->kcp_, kUCPHeaderSize);
+		configure_kcp(internel->kcp_, internel->config_);
+		internel->congestion_ =
+			make_congestion_controller(internel->config_.congestion);
+		if (internel->congestion_ != nullptr) {
+			internel->congestion_->attach(internel->kcp_);
+		}
+		internel->window_tuner_ = WindowTuner(internel->config_);
 		ikcp_update(internel->kcp_, iclock());
 
 		return kConnected;
@@ -86,38 +145,74 @@ Status ClientInternel::tranfer_status_from_handshake(
 Status ClientInternel::tranfer_status_from_connected(
 	std::shared_ptr<ClientInternel> internel)
 {
+	// drain the socket until it is empty or the budget is exhausted
+	size_t received = 0;
+	size_t count;
+	while ((count = ingest_batch_size(received,
+									  internel->ingest_budget_)) > 0) {
+		ssize_t ret =
+			internel->sock_->recv_batch(internel->recv_packets_.data(), count);
+		if (ret == -1) {
+			return kExit;
+		}
+
+		for (ssize_t i = 0; i < ret; i++) {
+			const Packet &packet = internel->recv_packets_[i];
+
+			Message msg;
+			if (!decode_message(packet.data, packet.size, msg)) {
+				continue; // malformed packet, drop it
+			}
+
+			Status status = handle_message(internel, msg, packet.address);
+			if (status != kConnected) {
+				return status;
+			}
+		}
+
+		received += ret;
+		if ((size_t)ret < count) { // no more data
+			break;
+		}
+	}
+
+	release_paced(internel); // queued packets go before new ones
 	ikcp_update(internel->kcp_, iclock());
+	internel->window_tuner_.update(internel->kcp_);
+	if (internel->flush_pending_) {
+		ikcp_flush(internel->kcp_);
+		internel->flush_pending_ = false;
+	}
 
 	auto now = std::chrono::steady_clock::now();
-	if (now - internel->last_hearbeat_time_ > kUCPDefaultHeartbeatTimeout) {
+	if (now - internel->last_hearbeat_time_ >
+		internel->config_.heartbeat_timeout) {
 		// remote timeout, do not release, just close
 		return kClosed;
 	}
 
-	if (now - internel->last_hearbeat_time_ > kUCPDefaultHeartbeatInterval) {
+	if (now - internel->last_hearbeat_time_ >
+			internel->config_.heartbeat_interval &&
+		now - internel->last_hearbeat_send_time_ >= internel->config_.tick()) {
 		Message msg = { kHeartbeat, internel->session_id_, 0 };
-		internel->sock_->send_to(&msg, sizeof(msg), internel->remote_address_);
+		internel->send_queue_.push(msg, internel->remote_endpoint_);
+		internel->last_hearbeat_send_time_ = now;
 	}
 
-	Message msg;
-	std::string address;
-	ssize_t ret = internel->sock_->recv_from(&msg, sizeof(msg), address);
-	if (ret == -1) {
-		return kExit;
-	}
+	return kConnected;
+}
 
-	if (ret == 0) {
+Status ClientInternel::handle_message(std::shared_ptr<ClientInternel> internel,
+									  const Message &msg,
+									  const Endpoint &from)
+{
+	// not from the server or stale, drop it. if local address changes, the
+	// server validates the new path and replies to it
+	if (from != internel->remote_endpoint_ ||
+		msg.session_id != internel->session_id_) {
 		return kConnected;
 	}
 
-	if (ret != sizeof(msg)) {
-		return kExit;
-	}
-
-	if (address != internel->remote_address_) {
-		return kExit;
-	}
-
 	if (msg.msg_type == kTypeCloseSession) {
 		return kClosed; // remote close, but recv may still work
 	}
@@ -128,22 +223,55 @@ Status ClientInternel::tranfer_status_from_connected(
 	} else if (msg.msg_type == kHeartbeat) {
 		internel->last_hearbeat_time_ = std::chrono::steady_clock::now();
 		return kConnected;
+	} else if (msg.msg_type == kTypePathChallenge) {
+		// prove the path by echoing the token
+		Message response = msg;
+		response.msg_type = kTypePathResponse;
+		internel->send_queue_.push(response, internel->remote_endpoint_);
+		return kConnected;
 	}
 
-	return kExit;
+	return kConnected; // unknown message, drop it
 }
 
 Status ClientInternel::tranfer_status_from_closed(
 	std::shared_ptr<ClientInternel> internel)
 {
-	Message msg;
-	std::string address;
-	ssize_t ret = internel->sock_->recv_from(&msg, sizeof(msg), address);
-	if (ret == -1) {
-		return kExit;
+	size_t received = 0;
+	size_t count;
+	while ((count = ingest_batch_size(received,
+									  internel->ingest_budget_)) > 0) {
+		ssize_t ret =
+			internel->sock_->recv_batch(internel->recv_packets_.data(), count);
+		if (ret == -1) {
+			return kExit;
+		}
+
+		for (ssize_t i = 0; i < ret; i++) {
+			const Packet &packet = internel->recv_packets_[i];
+
+			Message msg;
+			if (!decode_message(packet.data, packet.size, msg)) {
+				continue; // malformed packet, drop it
+			}
+
+			if (packet.address != internel->remote_endpoint_) {
+				continue; // not from the server, drop it
+			}
+
+			if (msg.msg_type == kTypeData) {
+				ikcp_input(internel->kcp_, msg.msg_data, msg.msg_size);
+			}
+		}
+
+		received += ret;
+		if ((size_t)ret < count) { // no more data
+			break;
+		}
 	}
 
-	if (ret == 0) {
+	release_paced(internel);
+	if (received == 0) {
 		ikcp_flush(internel->kcp_);
 		
 		Message msg;
@@ -151,45 +279,74 @@ Status ClientInternel::tranfer_status_from_closed(
 		msg.session_id = internel->session_id_;
 		msg.msg_size = 0;
 
-		internel->sock_->send_to(&msg, sizeof(msg), internel->remote_address_);
+		internel->send_queue_.push(msg, internel->remote_endpoint_);
 		return kClosed;
 	}
 
-	if (ret > 0 && address == internel->remote_address_ && ret == sizeof(msg)) {
-		if (msg.msg_type == kTypeData) {
-			ikcp_input(internel->kcp_, msg.msg_data, msg.msg_size);
-		}
+	ikcp_flush(internel->kcp_);
+	return kClosed;
+}
 
-		ikcp_flush(internel->kcp_);
-		return kClosed;
+int ClientInternel::ucp_output(const char *buf, int len, ikcpcb *kcp,
+							   void *user)
+{
+	if (len < 0) {
+		return -1;
 	}
 
-	return kExit;
+	IKCPVEC vec = { buf, len };
+	return ucp_outputv(&vec, 1, kcp, user);
 }
 
-int ClientInternel::ucp_output(const char *buf, int len, ikcpcb *kcp,
-							   void *user)
+int ClientInternel::ucp_outputv(const IKCPVEC *vec, int count, ikcpcb *kcp,
+								void *user)
 {
 	ClientInternel *internel = (ClientInternel *)user;
 
-	Message msg;
-	msg.msg_type = kTypeData;
-	msg.session_id = internel->session_id_;
-	msg.msg_size = len;
-	memcpy(msg.msg_data, buf, len);
+	// the header goes into the headroom of kcp, segment data is not copied
+	// until it reaches the send queue
+	struct iovec iov[2];
+	if (count <= 0 || count > 2) {
+		return -1;
+	}
+
+	size_t size = encode_kcp_packet(internel->session_id_, vec, count, iov);
+	internel->pacer_.send(iov, count, size, [internel](
+		const struct iovec *iov, size_t iovcnt) {
+		internel->send_queue_.push(iov, iovcnt, internel->remote_endpoint_);
+	});
+	return size - kUCPHeaderSize;
+}
 
-	return internel->sock_->send_to(&msg, sizeof(msg),
-									internel->remote_address_);
+void ClientInternel::release_paced(std::shared_ptr<ClientInternel> internel)
+{
+	if (internel->config_.pacing) {
+		auto &congestion = internel->congestion_;
+		uint64_t rate = congestion != nullptr ? congestion->pacing_rate() : 0;
+		internel->pacer_.rate(rate != 0 ? rate
+										: kcp_pacing_rate(internel->kcp_));
+	}
+
+	internel->pacer_.release([&internel](const struct iovec *iov,
+										 size_t iovcnt) {
+		internel->send_queue_.push(iov, iovcnt, internel->remote_endpoint_);
+	});
 }
 
 ClientInternel::ClientInternel(std::shared_ptr<Sock> sock)
 	: sock_(sock)
+	, send_queue_(sock)
+	, recv_packets_(kUCPBatchSize)
+	, ingest_budget_(kUCPDefaultIngestBudget)
 	, status_(kInit)
+	, window_tuner_(config_)
 	, kcp_(nullptr)
+	, flush_pending_(false)
+	, readers_(0)
+	, writers_(0)
 	, last_hearbeat_time_(std::chrono::steady_clock::now())
 {
 	local_address_.clear();
-	remote_address_.clear();
 	session_id_ = 0;
 }
 
@@ -221,33 +378,48 @@ bool ClientInternel::connect(const std::string &address)
 		return false;
 	}
 
+	Endpoint endpoint;
+	if (!sock_->resolve(address, endpoint)) {
+		return false;
+	}
+
+	Config config;
 	{
 		std::lock_guard<std::mutex> lock(status_mutex_);
 		if (status_ != kInit) {
 			return false;
 		}
 
-		remote_address_ = address;
+		remote_endpoint_ = endpoint;
 		status_ = kHandshake;
+		config = config_;
 	} // free lock
 
 	auto start = std::chrono::steady_clock::now();
 	do {
 		if (std::chrono::steady_clock::now() - start >
-			kUCPDefaultHandshakeTimeout) {
+			config.handshake_timeout) {
 			return false;
 		}
 
+		{
+			std::lock_guard<std::mutex> lock(status_mutex_);
+			if (status_ != kHandshake) { // rejected, e.g. backlog is full
+				return false;
+			}
+		}
+
 		Message msg;
 		msg.msg_type = kTypeNewSession;
 		msg.session_id = 0;
-		msg.msg_size = 0;
+		encode_features(msg, kUCPSupportedFeatures);
+		encode_config(msg, config);
 
-		if (sock_->send_to(&msg, sizeof(msg), remote_address_) == -1) {
+		if (send_message(sock_.get(), msg, remote_endpoint_) == -1) {
 			return false;
 		}
 
-	} while (!wait_for_accept_with_timeout_(kUCPDefaultHeartbeatTimeout));
+	} while (!wait_for_accept_with_timeout_(config.heartbeat_timeout));
 
 	return true;
 }
@@ -294,45 +466,226 @@ bool ClientInternel::wait_for_accept_with_timeout_(
 ssize_t ClientInternel::send(const void *data, size_t size)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
+	return send_locked(data, size);
+}
+
+ssize_t ClientInternel::send(const void *data, size_t size,
+							 std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(status_mutex_);
+	writers_++;
+	bool ready = wait_until_deadline(writable_, lock, deadline_after(timeout),
+									 [this] { return writable_locked(); });
+	writers_--;
+
+	return ready ? send_locked(data, size) : 0;
+}
+
+ssize_t ClientInternel::send_locked(const void *data, size_t size)
+{
 	if (status_ != kConnected) {
 		return -1;
 	}
 
 	int ret = ikcp_send(kcp_, (const char *)data, size);
-	return ret < 0 ? -1 : ret;
+	if (ret < 0) {
+		return -1;
+	}
+
+	// send it now instead of waiting for next kcp interval
+	flush_pending_ = true;
+	reactor_.wakeup();
+	return ret;
 }
 
 ssize_t ClientInternel::recv(void *data, size_t size)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
-	if (status_ != kConnected) {
+	return recv_locked(data, size);
+}
+
+ssize_t ClientInternel::recv(void *data, size_t size,
+							 std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(status_mutex_);
+	readers_++;
+	bool ready = wait_until_deadline(readable_, lock, deadline_after(timeout),
+									 [this] { return readable_locked(); });
+	readers_--;
+
+	return ready ? recv_locked(data, size) : 0;
+}
+
+ssize_t ClientInternel::recv_locked(void *data, size_t size)
+{
+	if (status_ != kConnected && status_ != kClosed) {
 		return -1;
 	}
 
 	int ret = ikcp_recv(kcp_, (char *)data, size);
+	if (ret < 0) {
+		// closed session only returns the data already received
+		return status_ == kClosed ? -1 : 0;
+	}
+
+	if (kcp_->probe != 0) { // window reopened, tell remote
+		reactor_.wakeup();
+	}
 
-	return ret < 0 ? 0 : ret;
+	return ret;
 }
 
-void ClientInternel::close()
+ssize_t ClientInternel::recv_view(MessageView &view)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
+	view.release();
+	if (status_ != kConnected && status_ != kClosed) {
+		return -1;
+	}
+
+	int size = 0;
+	IKCPSEG *segments = ikcp_recv_segments(kcp_, &size);
+	if (segments == nullptr) {
+		return status_ == kClosed ? -1 : 0;
+	}
+
+	if (kcp_->probe != 0) { // window reopened, tell remote
+		reactor_.wakeup();
+	}
+
+	view = MessageView(segments, size);
+	return size;
+}
+
+void ClientInternel::close()
+{
+	std::unique_lock<std::mutex> lock(status_mutex_);
 	if (status_ != kConnected) {
 		return;
 	}
 
 	status_ = kClosed;
+	notify_waiters();
+	reactor_.wakeup();
+	watchers_.run(lock);
 }
 
-void ClientInternel::exit()
+bool ClientInternel::when_readable(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	if (readable_locked()) {
+		return false;
+	}
+
+	watchers_.readable(std::move(callback));
+	return true;
+}
+
+bool ClientInternel::when_writable(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	if (writable_locked()) {
+		return false;
+	}
+
+	watchers_.writable(std::move(callback));
+	return true;
+}
+
+bool ClientInternel::readable_locked()
+{
+	return status_ != kConnected || ikcp_peeksize(kcp_) >= 0;
+}
+
+bool ClientInternel::writable_locked()
+{
+	return status_ != kConnected || kcp_writable(kcp_);
+}
+
+void ClientInternel::notify_waiters()
+{
+	if (readers_ == 0 && writers_ == 0 && watchers_.empty()) {
+		return;
+	}
+
+	bool readable = readable_locked();
+	bool writable = writable_locked();
+	if (readers_ > 0 && readable) {
+		readable_.notify_all();
+	}
+
+	if (writers_ > 0 && writable) {
+		writable_.notify_all();
+	}
+
+	watchers_.fire(readable, writable);
+}
+
+bool ClientInternel::handlers(std::shared_ptr<const Handlers> handlers,
+							  Dispatcher dispatcher)
+{
+	{
+		std::lock_guard<std::mutex> lock(status_mutex_);
+		if (status_ != kConnected) {
+			return false;
+		}
+	}
+
+	std::make_shared<SessionHandler>(shared_from_this(), 0, handlers,
+									 dispatcher)
+		->start(false);
+	return true;
+}
+
+void ClientInternel::ingest_budget(size_t budget)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
+	ingest_budget_ = budget;
+}
+
+bool ClientInternel::config(const Config &config)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	if (kcp_ != nullptr) {
+		return false;
+	}
+
+	config_ = config;
+	return true;
+}
+
+void ClientInternel::pacing(bool enable)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	config_.pacing = enable;
+	if (!config_.pacing) {
+		pacer_.rate(0);
+	}
+}
+
+bool ClientInternel::congestion_control(CongestionControl type)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	if (kcp_ != nullptr) {
+		return false;
+	}
+
+	config_.congestion = type;
+	return true;
+}
+
+void ClientInternel::exit()
+{
+	std::unique_lock<std::mutex> lock(status_mutex_);
 	if (status_ == kExit) {
 		return;
 	}
 
 	status_ = kExit;
+	notify_waiters();
 	sock_->close();
+	reactor_.wakeup();
+	watchers_.run(lock);
 }
 
 std::string ClientInternel::address()
@@ -1,6 +1,8 @@
 #ifndef UCP_SRC_UCPCLIENT_HPP_
 #define UCP_SRC_UCPCLIENT_HPP_
 
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <memory>
 #include <cstdint>
@@ -8,18 +10,29 @@
 #include <string>
 #include <sys/types.h>
 #include <thread>
+#include <vector>
 
 #include "ucpbase.hpp"
+#include "ucpcongestion.hpp"
+#include "ucpconfig.hpp"
+#include "ucphandler.hpp"
+#include "ucppacer.hpp"
+#include "ucpreactor.hpp"
+#include "ucpwindow.hpp"
 #include "kcp/ikcp.h"
 
 namespace ucp {
 
-class ClientInternel {
+// the session of Client, outlives it while handlers hold it
+class ClientInternel : public Session,
+					   public std::enable_shared_from_this<ClientInternel> {
 public:
 	static void monitor_thread_func(std::shared_ptr<ClientInternel> internel);
 
 private:
 	static int ucp_output(const char *buf, int len, ikcpcb *kcp, void *user);
+	static int ucp_outputv(const IKCPVEC *vec, int count, ikcpcb *kcp,
+						   void *user);
 	static Status
 	tranfer_status_from_init(std::shared_ptr<ClientInternel> internel);
 	static Status
@@ -28,37 +41,84 @@ private:
 	tranfer_status_from_connected(std::shared_ptr<ClientInternel> internel);
 	static Status
 	tranfer_status_from_closed(std::shared_ptr<ClientInternel> internel);
+	static Status handle_message(std::shared_ptr<ClientInternel> internel,
+								 const Message &msg,
+								 const Endpoint &from);
+	static std::chrono::milliseconds
+	next_timeout(std::shared_ptr<ClientInternel> internel);
+	static void release_paced(std::shared_ptr<ClientInternel> internel);
 
 public:
 	ClientInternel() = delete;
 	ClientInternel(std::shared_ptr<Sock> sock);
-	~ClientInternel();
+	~ClientInternel() override;
 
 	bool bind(const std::string &address);
 	bool connect(const std::string &address);
-	ssize_t send(const void *data, size_t size);
-	ssize_t recv(void *data, size_t size);
-	void close();
+	ssize_t send(const void *data, size_t size) override;
+	ssize_t send(const void *data, size_t size,
+				 std::chrono::milliseconds timeout) override;
+	ssize_t recv(void *data, size_t size) override;
+	ssize_t recv(void *data, size_t size,
+				 std::chrono::milliseconds timeout) override;
+	ssize_t recv_view(MessageView &view) override;
+	bool when_readable(std::function<void()> callback) override;
+	bool when_writable(std::function<void()> callback) override;
+	void close() override;
+	bool handlers(std::shared_ptr<const Handlers> handlers,
+				  Dispatcher dispatcher);
+	void ingest_budget(size_t budget);
+	bool config(const Config &config);
+	bool congestion_control(CongestionControl type);
+	void pacing(bool enable);
 
 	void exit();
 
-	std::string address();
+	std::string address() override;
 
 private:
 	bool wait_for_accept_with_timeout_(std::chrono::milliseconds timeout);
 	bool wait_for_accept_();
 
+	// called with status_mutex_ held
+	ssize_t send_locked(const void *data, size_t size);
+	ssize_t recv_locked(void *data, size_t size);
+
+	// wake blocked send and recv which can go on and fire watchers, called
+	// with status_mutex_ held after input or a status change
+	void notify_waiters();
+
+	bool readable_locked();
+	bool writable_locked();
+
 private:
 	std::shared_ptr<Sock> sock_;
+	SendQueue send_queue_;
+	std::vector<Packet> recv_packets_;
+	size_t ingest_budget_;
 	Status status_;
 	std::mutex status_mutex_;
 
 	std::string local_address_;
-	std::string remote_address_;
+	Endpoint remote_endpoint_;
 	uint32_t session_id_;
+	Config config_;
+	std::unique_ptr<CongestionController> congestion_;
+	Pacer pacer_;
+	WindowTuner window_tuner_;
 	ikcpcb *kcp_;
+	bool flush_pending_;
+	Reactor reactor_;
+
+	// blocked recv and send
+	std::condition_variable readable_;
+	std::condition_variable writable_;
+	size_t readers_;
+	size_t writers_;
+	SessionWatchers watchers_;
 
 	std::chrono::steady_clock::time_point last_hearbeat_time_;
+	std::chrono::steady_clock::time_point last_hearbeat_send_time_;
 };
 
 template <class T>
@@ -113,6 +173,18 @@ public:
 		return internel_->send(data, size);
 	}
 
+	/**
+	 * @brief send data to server, waiting while the send buffer is full
+	 * 
+	 * @param timeout kUCPNoTimeout to wait without timeout
+	 * @return ssize_t size of data sent, -1 if error, 0 if timed out
+	 */
+	ssize_t send(const void *data, size_t size,
+				 std::chrono::milliseconds timeout) override
+	{
+		return internel_->send(data, size, timeout);
+	}
+
 	/**
 	 * @brief recv data from server
 	 * 
@@ -125,6 +197,46 @@ public:
 		return internel_->recv(data, size);
 	}
 
+	/**
+	 * @brief recv data from server, waiting until a message arrives
+	 * 
+	 * @param timeout kUCPNoTimeout to wait without timeout
+	 * @return ssize_t size of data received, -1 if error or closed, 0 if
+	 * timed out
+	 */
+	ssize_t recv(void *data, size_t size,
+				 std::chrono::milliseconds timeout) override
+	{
+		return internel_->recv(data, size, timeout);
+	}
+
+	/**
+	 * @brief recv data from server in place, see Session::recv_view
+	 * 
+	 */
+	ssize_t recv_view(MessageView &view) override
+	{
+		return internel_->recv_view(view);
+	}
+
+	/**
+	 * @brief see Session::when_readable
+	 * 
+	 */
+	bool when_readable(std::function<void()> callback) override
+	{
+		return internel_->when_readable(std::move(callback));
+	}
+
+	/**
+	 * @brief see Session::when_writable
+	 * 
+	 */
+	bool when_writable(std::function<void()> callback) override
+	{
+		return internel_->when_writable(std::move(callback));
+	}
+
 	/**
 	 * @brief close session
 	 * 
@@ -139,6 +251,69 @@ public:
 		return internel_->address();
 	}
 
+	/**
+	 * @brief push messages and events of the session to handlers instead of
+	 * recv, on_accept is not called
+	 * 
+	 * @param handlers 
+	 * @param dispatcher runs handlers, nullptr to run them in the network
+	 * thread, which must not be blocked by them
+	 * @return true 
+	 * @return false if not connected
+	 */
+	bool handlers(const Handlers &handlers, Dispatcher dispatcher = nullptr)
+	{
+		return internel_->handlers(std::make_shared<const Handlers>(handlers),
+								   std::move(dispatcher));
+	}
+
+	/**
+	 * @brief set max packets read from socket in one tick
+	 * 
+	 * @param budget 0 for no limit
+	 */
+	void ingest_budget(size_t budget)
+	{
+		internel_->ingest_budget(budget);
+	}
+
+	/**
+	 * @brief set config to offer in handshake, the session runs the config
+	 * negotiated with the server
+	 * 
+	 * @param config 
+	 * @return true 
+	 * @return false if already connected
+	 */
+	bool config(const Config &config)
+	{
+		return internel_->config(config);
+	}
+
+	/**
+	 * @brief set congestion control of the session, kCongestionNone by
+	 * default
+	 * 
+	 * @param type 
+	 * @return true 
+	 * @return false if already connected
+	 */
+	bool congestion_control(CongestionControl type)
+	{
+		return internel_->congestion_control(type);
+	}
+
+	/**
+	 * @brief pace output at a rate from cwnd and srtt, or the rate of the
+	 * congestion controller, enabled by default
+	 * 
+	 * @param enable 
+	 */
+	void pacing(bool enable)
+	{
+		internel_->pacing(enable);
+	}
+
 private:
 	std::shared_ptr<ClientInternel> internel_;
 	std::thread monitor_thread_;
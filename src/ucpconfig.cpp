@@ -0,0 +1,194 @@
+#include "ucpconfig.hpp"
+
+#include <algorithm>
+
+using namespace ucp;
+
+namespace {
+
+// config follows the features in the payload
+constexpr size_t kConfigOffset = 4;
+
+constexpr uint32_t kMinMtu = 64;
+constexpr uint32_t kMaxWnd = 0xffff;
+constexpr int kMinInterval = 10;
+constexpr int kMaxInterval = 5000;
+constexpr std::chrono::milliseconds kMinHeartbeatInterval =
+	std::chrono::milliseconds(100);
+
+void put_u16(char *&p, uint32_t value)
+{
+	*p++ = (char)(value & 0xff);
+	*p++ = (char)((value >> 8) & 0xff);
+}
+
+void put_u32(char *&p, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		*p++ = (char)((value >> (i * 8)) & 0xff);
+	}
+}
+
+uint32_t get_u16(const unsigned char *&p)
+{
+	uint32_t value = p[0] | (uint32_t)p[1] << 8;
+	p += 2;
+	return value;
+}
+
+uint32_t get_u32(const unsigned char *&p)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++) {
+		value |= (uint32_t)p[i] << (i * 8);
+	}
+	p += 4;
+	return value;
+}
+
+uint32_t clamp_wnd(uint32_t wnd)
+{
+	return std::min(std::max<uint32_t>(wnd, 1), kMaxWnd);
+}
+
+} // namespace
+
+Config Config::profile(Profile profile)
+{
+	Config config;
+
+	switch (profile) {
+	case kProfileLowLatency:
+		config.interval = 10;
+		config.resend = 2;
+		config.snd_wnd = 256;
+		config.rcv_wnd = 256;
+		config.max_wnd = 1024;
+		config.pacing = false;
+		config.heartbeat_interval = std::chrono::milliseconds(1000);
+		config.heartbeat_timeout = std::chrono::milliseconds(5000);
+		config.handshake_timeout = std::chrono::milliseconds(1000);
+		break;
+	case kProfileBulkThroughput:
+		config.nodelay = 0;
+		config.nocwnd = 0;
+		config.snd_wnd = 1024;
+		config.rcv_wnd = 1024;
+		config.max_wnd = 16384;
+		config.congestion = kCongestionBbr;
+		break;
+	case kProfileLowPower:
+		config.nodelay = 0;
+		config.interval = 50;
+		config.resend = 0;
+		config.nocwnd = 0;
+		config.autotune = false;
+		config.congestion = kCongestionNewReno;
+		config.heartbeat_interval = std::chrono::milliseconds(30000);
+		config.heartbeat_timeout = std::chrono::milliseconds(120000);
+		config.handshake_timeout = std::chrono::milliseconds(5000);
+		break;
+	default:
+		break;
+	}
+
+	return config;
+}
+
+bool Config::profile(const std::string &name, Config &config)
+{
+	if (name == "default") {
+		config = profile(kProfileDefault);
+	} else if (name == "low-latency") {
+		config = profile(kProfileLowLatency);
+	} else if (name == "bulk-throughput") {
+		config = profile(kProfileBulkThroughput);
+	} else if (name == "low-power") {
+		config = profile(kProfileLowPower);
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+std::chrono::milliseconds Config::tick() const
+{
+	return std::chrono::milliseconds(
+		std::min(std::max(interval, kMinInterval), kMaxInterval));
+}
+
+void ucp::encode_config(Message &msg, const Config &config)
+{
+	char *p = msg.msg_data + msg.msg_size;
+	*p++ = (char)config.nodelay;
+	*p++ = (char)config.resend;
+	*p++ = (char)config.nocwnd;
+	*p++ = (char)config.congestion;
+	*p++ = (char)config.pacing;
+	put_u16(p, config.tick().count());
+	put_u16(p, std::min<uint32_t>(config.mtu, kUCPKcpMtu));
+	put_u16(p, clamp_wnd(config.snd_wnd));
+	put_u16(p, clamp_wnd(config.rcv_wnd));
+	put_u32(p, config.heartbeat_interval.count());
+	put_u32(p, config.heartbeat_timeout.count());
+	msg.msg_size += kUCPConfigSize;
+}
+
+bool ucp::decode_config(const Message &msg, Config &config)
+{
+	if (msg.msg_size < kConfigOffset + kUCPConfigSize) {
+		return false;
+	}
+
+	const unsigned char *p =
+		(const unsigned char *)msg.msg_data + kConfigOffset;
+	config.nodelay = *p++ ? 1 : 0;
+	config.resend = *p++;
+	config.nocwnd = *p++ ? 1 : 0;
+	config.congestion = *p <= kCongestionBbr ? (CongestionControl)*p
+											 : kCongestionNone;
+	p++;
+	config.pacing = *p++ != 0;
+	config.interval = std::min(std::max((int)get_u16(p), kMinInterval),
+							   kMaxInterval);
+	config.mtu = std::min(std::max(get_u16(p), kMinMtu), (uint32_t)kUCPKcpMtu);
+	config.snd_wnd = clamp_wnd(get_u16(p));
+	config.rcv_wnd = clamp_wnd(get_u16(p));
+	config.heartbeat_interval = std::max(
+		std::chrono::milliseconds(get_u32(p)), kMinHeartbeatInterval);
+	config.heartbeat_timeout = std::max(
+		std::chrono::milliseconds(get_u32(p)), config.heartbeat_interval);
+	return true;
+}
+
+Config ucp::negotiate_config(const Config &local, const Config &offer)
+{
+	Config config = local;
+	config.mtu = std::min(local.mtu, offer.mtu);
+	config.snd_wnd = std::min(local.snd_wnd, offer.rcv_wnd);
+	config.heartbeat_interval =
+		std::min(local.heartbeat_interval, offer.heartbeat_interval);
+	config.heartbeat_timeout =
+		std::max(local.heartbeat_timeout, offer.heartbeat_timeout);
+	return config;
+}
+
+Config ucp::adopt_config(const Config &local, const Config &agreed)
+{
+	Config config = agreed;
+	config.snd_wnd = std::min(local.snd_wnd, agreed.rcv_wnd);
+	config.rcv_wnd = local.rcv_wnd;
+	config.autotune = local.autotune;
+	config.max_wnd = local.max_wnd;
+	config.handshake_timeout = local.handshake_timeout;
+	return config;
+}
+
+void ucp::configure_kcp(ikcpcb *kcp, const Config &config)
+{
+	int nodelay = config.congestion == kCongestionNone ? config.nodelay : 0;
+	ikcp_nodelay(kcp, nodelay, config.interval, config.resend, config.nocwnd);
+	ikcp_wndsize(kcp, config.snd_wnd, config.rcv_wnd);
+	ikcp_setmtu(kcp, std::min<uint32_t>(config.mtu, kUCPKcpMtu));
+}
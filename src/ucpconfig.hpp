@@ -0,0 +1,136 @@
+#ifndef UCP_SRC_UCPCONFIG_HPP_
+#define UCP_SRC_UCPCONFIG_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "ucpbase.hpp"
+#include "ucpcongestion.hpp"
+#include "kcp/ikcp.h"
+
+namespace ucp {
+
+enum Profile {
+	kProfileDefault = 0,
+	kProfileLowLatency, // "low-latency", react fast, no pacing
+	kProfileBulkThroughput, // "bulk-throughput", large windows with bbr
+	kProfileLowPower, // "low-power", slow ticks and rare heartbeats
+};
+
+/**
+ * @brief tunables of a session. the client offers its config in the
+ * handshake, the server picks the config of the session and answers it, see
+ * negotiate_config
+ *
+ */
+struct Config {
+	// see ikcp_nodelay, nodelay is ignored with a congestion controller,
+	// which needs the normal rto
+	int nodelay = 1;
+	int interval = 10; // ms, 10 to 5000
+	int resend = 2;
+	int nocwnd = 1;
+
+	uint32_t snd_wnd = 128;
+	uint32_t rcv_wnd = 128;
+	uint32_t mtu = kUCPKcpMtu; // at most kUCPKcpMtu
+
+	// local only, windows grow from the above up to max_wnd segments as the
+	// bandwidth-delay product needs, see WindowTuner
+	bool autotune = true;
+	uint32_t max_wnd = 4096;
+
+	CongestionControl congestion = kCongestionNone;
+	bool pacing = true;
+
+	std::chrono::milliseconds heartbeat_interval =
+		kUCPDefaultHeartbeatInterval;
+	std::chrono::milliseconds heartbeat_timeout = kUCPDefaultHeartbeatTimeout;
+
+	// local only, not negotiated
+	std::chrono::milliseconds handshake_timeout = kUCPDefaultHandshakeTimeout;
+
+	/**
+	 * @brief get config of a profile
+	 *
+	 */
+	static Config profile(Profile profile);
+
+	/**
+	 * @brief get config of a profile by name
+	 *
+	 * @param name "default", "low-latency", "bulk-throughput" or "low-power"
+	 * @param config set to the profile
+	 * @return true
+	 * @return false if name is unknown
+	 */
+	static bool profile(const std::string &name, Config &config);
+
+	/**
+	 * @brief tick of the session, the kcp interval
+	 *
+	 */
+	std::chrono::milliseconds tick() const;
+};
+
+/**
+ * @brief picks the config of a new session on the server, called by the
+ * server threads
+ *
+ * @param from address of the client
+ * @param offer config offered by the client, the server config if none
+ * @param config config of the session, the server config initially
+ */
+using ConfigSelector = std::function<void(
+	const Endpoint &from, const Config &offer, Config &config)>;
+
+// size of config on the wire
+constexpr size_t kUCPConfigSize = 21;
+
+/**
+ * @brief append config to the payload of a handshake message, after the
+ * features
+ *
+ */
+void encode_config(Message &msg, const Config &config);
+
+/**
+ * @brief get config from the payload of a handshake message, values out of
+ * range are clamped
+ *
+ * @return true
+ * @return false if the peer sent no config
+ */
+bool decode_config(const Message &msg, Config &config);
+
+/**
+ * @brief get config of a session on the server, the tunables of local win
+ * while mtu and windows are limited by the offer, and heartbeats go at the
+ * faster interval and time out at the longer timeout of both
+ *
+ * @param local config picked by the server
+ * @param offer config offered by the client
+ */
+Config negotiate_config(const Config &local, const Config &offer);
+
+/**
+ * @brief get config of a session on the client from the answer of server,
+ * the send window is limited by the receive window of the server and local
+ * only tunables stay
+ *
+ * @param local config of the client
+ * @param agreed config answered by the server
+ */
+Config adopt_config(const Config &local, const Config &agreed);
+
+/**
+ * @brief apply nodelay, windows and mtu of config to kcp
+ *
+ */
+void configure_kcp(ikcpcb *kcp, const Config &config);
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPCONFIG_HPP_
@@ -0,0 +1,399 @@
+#include "ucpcongestion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace ucp;
+
+namespace {
+
+// initial window of rfc 6928
+constexpr uint32_t kInitialCwnd = 10;
+
+// smallest window keeping acks flowing
+constexpr uint32_t kBbrMinCwnd = 4;
+
+// 2/ln(2), doubles delivery rate each round in startup
+constexpr double kBbrHighGain = 2.885;
+
+constexpr double kBbrCwndGain = 2.0;
+
+// bandwidth is still growing if it grows by a quarter in a round
+constexpr double kBbrFullBandwidthGrowth = 1.25;
+constexpr uint32_t kBbrFullBandwidthRounds = 3;
+
+constexpr double kBbrPacingGains[] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+constexpr size_t kBbrCycleLength =
+	sizeof(kBbrPacingGains) / sizeof(kBbrPacingGains[0]);
+
+constexpr uint32_t kBbrMinRttWindow = 10000;
+constexpr uint32_t kBbrProbeRttTime = 200;
+
+inline int32_t time_diff(uint32_t later, uint32_t earlier)
+{
+	return (int32_t)(later - earlier);
+}
+
+} // namespace
+
+CongestionController::CongestionController()
+	: kcp_(nullptr)
+{
+	hooks_.on_send = send_hook;
+	hooks_.on_ack = ack_hook;
+	hooks_.on_loss = loss_hook;
+	hooks_.on_rtt = rtt_hook;
+	hooks_.user = this;
+}
+
+void CongestionController::attach(ikcpcb *kcp)
+{
+	kcp_ = kcp;
+	ikcp_setcc(kcp_, &hooks_);
+	apply();
+}
+
+uint64_t CongestionController::pacing_rate() const
+{
+	return 0;
+}
+
+void CongestionController::on_send(uint32_t /*sn*/, uint32_t /*xmit*/)
+{
+}
+
+void CongestionController::on_rtt(int32_t /*rtt*/)
+{
+}
+
+uint32_t CongestionController::inflight() const
+{
+	return kcp_->nsnd_buf;
+}
+
+int32_t CongestionController::interval() const
+{
+	return kcp_->interval > 0 ? kcp_->interval : 1;
+}
+
+void CongestionController::send_hook(ikcpcb *, void *user, IUINT32 sn,
+									 IUINT32 xmit)
+{
+	auto controller = static_cast<CongestionController *>(user);
+	controller->on_send(sn, xmit);
+	controller->apply();
+}
+
+void CongestionController::ack_hook(ikcpcb *, void *user, IUINT32 acked)
+{
+	auto controller = static_cast<CongestionController *>(user);
+	controller->on_ack(acked);
+	controller->apply();
+}
+
+void CongestionController::loss_hook(ikcpcb *, void *user, int timeout)
+{
+	auto controller = static_cast<CongestionController *>(user);
+	controller->on_loss(timeout != 0);
+	controller->apply();
+}
+
+void CongestionController::rtt_hook(ikcpcb *, void *user, IINT32 rtt)
+{
+	auto controller = static_cast<CongestionController *>(user);
+	controller->on_rtt(rtt);
+	controller->apply();
+}
+
+void CongestionController::apply()
+{
+	kcp_->cwnd = std::max<uint32_t>(cwnd(), 1);
+}
+
+NewRenoController::NewRenoController()
+	: cwnd_(kInitialCwnd)
+	, ssthresh_(UINT32_MAX)
+	, acked_(0)
+	, recovery_sn_(0)
+	, in_recovery_(false)
+{
+}
+
+uint32_t NewRenoController::cwnd() const
+{
+	return cwnd_;
+}
+
+void NewRenoController::on_ack(uint32_t acked)
+{
+	// recovery ends when everything sent before the loss is acked
+	if (in_recovery_) {
+		if (time_diff(kcp_->snd_una, recovery_sn_) < 0) {
+			return;
+		}
+		in_recovery_ = false;
+	}
+
+	if (cwnd_ >= kcp_->rmt_wnd) {
+		return;
+	}
+
+	if (cwnd_ < ssthresh_) {
+		cwnd_ += acked;
+	} else {
+		acked_ += acked;
+		while (acked_ >= cwnd_) {
+			acked_ -= cwnd_;
+			cwnd_++;
+		}
+	}
+
+	cwnd_ = std::min<uint32_t>(cwnd_, kcp_->rmt_wnd);
+}
+
+void NewRenoController::on_loss(bool timeout)
+{
+	if (timeout) {
+		ssthresh_ = std::max<uint32_t>(cwnd_ / 2, 2);
+		cwnd_ = 1;
+		acked_ = 0;
+		in_recovery_ = false;
+		return;
+	}
+
+	// one reduction per window of data
+	if (in_recovery_) {
+		return;
+	}
+
+	ssthresh_ = std::max<uint32_t>(inflight() / 2, 2);
+	cwnd_ = ssthresh_;
+	acked_ = 0;
+	in_recovery_ = true;
+	recovery_sn_ = kcp_->snd_nxt;
+}
+
+BbrController::BbrController()
+	: mode_(kStartup)
+	, pacing_gain_(kBbrHighGain)
+	, cwnd_gain_(kBbrHighGain)
+	, cwnd_(kInitialCwnd)
+	, bandwidth_samples_()
+	, bandwidth_index_(0)
+	, round_(0)
+	, delivered_(0)
+	, round_delivered_(0)
+	, round_start_(0)
+	, round_end_sn_(0)
+	, min_rtt_(0)
+	, min_rtt_time_(0)
+	, full_bandwidth_(0)
+	, full_bandwidth_rounds_(0)
+	, full_pipe_(false)
+	, cycle_index_(0)
+	, probe_rtt_done_(0)
+	, probe_rtt_round_(0)
+	, probe_rtt_draining_(false)
+{
+}
+
+uint32_t BbrController::cwnd() const
+{
+	return cwnd_;
+}
+
+uint64_t BbrController::pacing_rate() const
+{
+	double rate = bandwidth();
+	if (rate <= 0) { // no estimate yet
+		return 0;
+	}
+
+	return (uint64_t)(pacing_gain_ * rate * kcp_->mss * 1000);
+}
+
+void BbrController::on_ack(uint32_t acked)
+{
+	// inflight was below cwnd with nothing queued, the rate is the app's
+	bool app_limited =
+		kcp_->nsnd_que == 0 && inflight() + acked < kcp_->cwnd;
+
+	if (round_ == 0) { // the first round starts at the first ack
+		round_ = 1;
+		round_start_ = kcp_->current;
+		round_end_sn_ = kcp_->snd_nxt;
+	}
+
+	delivered_ += acked;
+	if (time_diff(kcp_->snd_una, round_end_sn_) >= 0) {
+		end_round(app_limited);
+	}
+
+	update_mode();
+	update_cwnd(acked);
+}
+
+void BbrController::on_loss(bool timeout)
+{
+	// the model ignores random loss, a timeout restarts the window
+	if (timeout) {
+		cwnd_ = kBbrMinCwnd;
+	}
+}
+
+void BbrController::on_rtt(int32_t rtt)
+{
+	// kcp clock and acks advance by interval, a shorter rtt is not seen
+	uint32_t sample = std::max<int32_t>(rtt, interval());
+	bool expired = time_diff(kcp_->current, min_rtt_time_) >
+				   (int32_t)kBbrMinRttWindow;
+
+	if (min_rtt_ == 0 || sample < min_rtt_ ||
+		(expired && mode_ == kProbeRtt)) {
+		min_rtt_ = sample;
+		min_rtt_time_ = kcp_->current;
+	}
+}
+
+double BbrController::bandwidth() const
+{
+	return *std::max_element(bandwidth_samples_,
+							 bandwidth_samples_ + kBandwidthRounds);
+}
+
+double BbrController::bdp() const
+{
+	return bandwidth() * min_rtt_;
+}
+
+void BbrController::end_round(bool app_limited)
+{
+	uint32_t elapsed =
+		std::max<int32_t>(time_diff(kcp_->current, round_start_), interval());
+	double rate = (double)(delivered_ - round_delivered_) / elapsed;
+
+	// app limited rounds underestimate the path, they neither age the
+	// filter nor end startup unless they beat it
+	bool valid = !app_limited || rate > bandwidth();
+	if (valid) {
+		bandwidth_samples_[bandwidth_index_] = rate;
+		bandwidth_index_ = (bandwidth_index_ + 1) % kBandwidthRounds;
+		check_full_pipe();
+	}
+
+	round_++;
+	round_start_ = kcp_->current;
+	round_delivered_ = delivered_;
+	round_end_sn_ = kcp_->snd_nxt;
+
+	if (mode_ == kProbeBw) {
+		cycle_index_ = (cycle_index_ + 1) % kBbrCycleLength;
+		pacing_gain_ = kBbrPacingGains[cycle_index_];
+	}
+}
+
+void BbrController::check_full_pipe()
+{
+	if (full_pipe_) {
+		return;
+	}
+
+	double rate = bandwidth();
+	if (rate >= full_bandwidth_ * kBbrFullBandwidthGrowth) {
+		full_bandwidth_ = rate;
+		full_bandwidth_rounds_ = 0;
+		return;
+	}
+
+	if (++full_bandwidth_rounds_ >= kBbrFullBandwidthRounds) {
+		full_pipe_ = true;
+	}
+}
+
+void BbrController::update_mode()
+{
+	uint32_t now = kcp_->current;
+
+	if (mode_ == kStartup && full_pipe_) {
+		mode_ = kDrain;
+		pacing_gain_ = 1 / kBbrHighGain;
+		cwnd_gain_ = kBbrHighGain;
+	}
+
+	if (mode_ == kDrain && inflight() <= bdp()) {
+		mode_ = kProbeBw;
+		cwnd_gain_ = kBbrCwndGain;
+		cycle_index_ = round_ % kBbrCycleLength;
+		pacing_gain_ = kBbrPacingGains[cycle_index_];
+	}
+
+	if (mode_ != kProbeRtt && min_rtt_ != 0 &&
+		time_diff(now, min_rtt_time_) > (int32_t)kBbrMinRttWindow) {
+		mode_ = kProbeRtt;
+		pacing_gain_ = 1;
+		cwnd_gain_ = 1;
+		probe_rtt_draining_ = true;
+	}
+
+	if (mode_ != kProbeRtt) {
+		return;
+	}
+
+	// hold the minimal window for a while and at least a round
+	if (probe_rtt_draining_) {
+		if (inflight() <= kBbrMinCwnd) {
+			probe_rtt_draining_ = false;
+			probe_rtt_done_ = now + kBbrProbeRttTime;
+			probe_rtt_round_ = round_ + 1;
+		}
+		return;
+	}
+
+	if (time_diff(now, probe_rtt_done_) >= 0 && round_ >= probe_rtt_round_) {
+		min_rtt_time_ = now;
+		if (full_pipe_) {
+			mode_ = kProbeBw;
+			cwnd_gain_ = kBbrCwndGain;
+			cycle_index_ = round_ % kBbrCycleLength;
+			pacing_gain_ = kBbrPacingGains[cycle_index_];
+		} else {
+			mode_ = kStartup;
+			pacing_gain_ = kBbrHighGain;
+			cwnd_gain_ = kBbrHighGain;
+		}
+	}
+}
+
+void BbrController::update_cwnd(uint32_t acked)
+{
+	if (mode_ == kProbeRtt) {
+		cwnd_ = kBbrMinCwnd;
+		return;
+	}
+
+	double target = cwnd_gain_ * bdp();
+	if (target <= 0) { // no estimate yet, grow as slow start
+		cwnd_ += acked;
+	} else if (full_pipe_) {
+		cwnd_ = std::min<uint32_t>(cwnd_ + acked, (uint32_t)std::ceil(target));
+	} else if (cwnd_ < target || delivered_ < kInitialCwnd) {
+		cwnd_ += acked;
+	}
+
+	cwnd_ = std::max(cwnd_, kBbrMinCwnd);
+	cwnd_ = std::min(cwnd_, std::max(kcp_->rmt_wnd, kBbrMinCwnd));
+}
+
+std::unique_ptr<CongestionController>
+ucp::make_congestion_controller(CongestionControl type)
+{
+	switch (type) {
+	case kCongestionNewReno:
+		return std::unique_ptr<CongestionController>(new NewRenoController());
+	case kCongestionBbr:
+		return std::unique_ptr<CongestionController>(new BbrController());
+	default:
+		return nullptr;
+	}
+}
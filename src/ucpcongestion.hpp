@@ -0,0 +1,179 @@
+#ifndef UCP_SRC_UCPCONGESTION_HPP_
+#define UCP_SRC_UCPCONGESTION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "kcp/ikcp.h"
+
+namespace ucp {
+
+enum CongestionControl {
+	kCongestionNone = 0, // kcp without congestion window
+	kCongestionNewReno,
+	kCongestionBbr,
+};
+
+/**
+ * @brief congestion controller of a session, attached to its kcp by
+ * ikcp_setcc and called with the kcp lock held. windows are counted in
+ * segments, times in kcp clock millisec
+ *
+ */
+class CongestionController {
+public:
+	CongestionController();
+	virtual ~CongestionController() = default;
+
+	CongestionController(const CongestionController &) = delete;
+	CongestionController &operator=(const CongestionController &) = delete;
+
+	/**
+	 * @brief install hooks into kcp, the controller must outlive kcp
+	 *
+	 */
+	void attach(ikcpcb *kcp);
+
+	/**
+	 * @brief congestion window in segments
+	 *
+	 */
+	virtual uint32_t cwnd() const = 0;
+
+	/**
+	 * @brief rate the sender should be paced at
+	 *
+	 * @return uint64_t bytes per second, 0 to let the pacer derive it from
+	 * cwnd and srtt
+	 */
+	virtual uint64_t pacing_rate() const;
+
+protected:
+	virtual void on_send(uint32_t sn, uint32_t xmit);
+	virtual void on_ack(uint32_t acked) = 0;
+	virtual void on_loss(bool timeout) = 0;
+	virtual void on_rtt(int32_t rtt);
+
+	// segments in flight
+	uint32_t inflight() const;
+
+	// update interval of kcp, the resolution of its clock
+	int32_t interval() const;
+
+	ikcpcb *kcp_;
+
+private:
+	static void send_hook(ikcpcb *kcp, void *user, IUINT32 sn, IUINT32 xmit);
+	static void ack_hook(ikcpcb *kcp, void *user, IUINT32 acked);
+	static void loss_hook(ikcpcb *kcp, void *user, int timeout);
+	static void rtt_hook(ikcpcb *kcp, void *user, IINT32 rtt);
+
+	// push cwnd into kcp after each callback
+	void apply();
+
+	IKCPCC hooks_;
+};
+
+/**
+ * @brief loss based controller, slow start then additive increase, halves
+ * the window at most once per rtt on fast resend, and restarts from one
+ * segment on timeout
+ *
+ */
+class NewRenoController : public CongestionController {
+public:
+	NewRenoController();
+
+	uint32_t cwnd() const override;
+
+protected:
+	void on_ack(uint32_t acked) override;
+	void on_loss(bool timeout) override;
+
+private:
+	uint32_t cwnd_;
+	uint32_t ssthresh_;
+	uint32_t acked_; // acked in congestion avoidance, one cwnd adds one
+	uint32_t recovery_sn_; // snd_nxt when recovery started
+	bool in_recovery_;
+};
+
+/**
+ * @brief model based controller in the way of bbr, estimates bottleneck
+ * bandwidth by max delivery rate over recent rounds and propagation delay
+ * by min rtt, then sizes cwnd and pacing rate from their product. losses
+ * do not shrink the window unless timeout
+ *
+ */
+class BbrController : public CongestionController {
+public:
+	BbrController();
+
+	uint32_t cwnd() const override;
+	uint64_t pacing_rate() const override;
+
+protected:
+	void on_ack(uint32_t acked) override;
+	void on_loss(bool timeout) override;
+	void on_rtt(int32_t rtt) override;
+
+private:
+	enum Mode {
+		kStartup,
+		kDrain,
+		kProbeBw,
+		kProbeRtt,
+	};
+
+	static constexpr size_t kBandwidthRounds = 10;
+
+	// segments per millisec
+	double bandwidth() const;
+
+	// bandwidth delay product in segments, 0 if not estimated
+	double bdp() const;
+
+	void end_round(bool app_limited);
+	void check_full_pipe();
+	void update_mode();
+	void update_cwnd(uint32_t acked);
+
+	Mode mode_;
+	double pacing_gain_;
+	double cwnd_gain_;
+	uint32_t cwnd_;
+
+	// delivery rate of recent rounds, a max filter
+	double bandwidth_samples_[kBandwidthRounds];
+	size_t bandwidth_index_;
+	uint64_t round_;
+	uint64_t delivered_;
+	uint64_t round_delivered_;
+	uint32_t round_start_;
+	uint32_t round_end_sn_;
+
+	uint32_t min_rtt_; // 0 if no sample
+	uint32_t min_rtt_time_;
+
+	double full_bandwidth_;
+	uint32_t full_bandwidth_rounds_;
+	bool full_pipe_;
+
+	size_t cycle_index_;
+	uint32_t probe_rtt_done_;
+	uint64_t probe_rtt_round_;
+	bool probe_rtt_draining_;
+};
+
+/**
+ * @brief create a controller
+ *
+ * @return std::unique_ptr<CongestionController> nullptr for kCongestionNone
+ */
+std::unique_ptr<CongestionController>
+make_congestion_controller(CongestionControl type);
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPCONGESTION_HPP_
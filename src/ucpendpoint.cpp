@@ -0,0 +1,80 @@
+#include "ucpendpoint.hpp"
+
+#include <arpa/inet.h>
+#include <cstdlib>
+
+using namespace ucp;
+
+bool Endpoint::parse(const std::string &address)
+{
+	std::string host;
+	std::string port;
+
+	if (!address.empty() && address[0] == '[') { // [ipv6]:port
+		auto pos = address.find("]:");
+		if (pos == std::string::npos) {
+			return false;
+		}
+
+		host = address.substr(1, pos - 1);
+		port = address.substr(pos + 2);
+	} else {
+		auto pos = address.rfind(':');
+		if (pos == std::string::npos) {
+			return false;
+		}
+
+		host = address.substr(0, pos);
+		port = address.substr(pos + 1);
+	}
+
+	char *end = nullptr;
+	unsigned long port_value = strtoul(port.c_str(), &end, 10);
+	if (port.empty() || *end != '\0' || port_value > 65535) {
+		return false;
+	}
+
+	Endpoint endpoint;
+	if (inet_pton(AF_INET, host.c_str(), &endpoint.addr.v4.sin_addr) == 1) {
+		endpoint.addr.v4.sin_family = AF_INET;
+		endpoint.addr.v4.sin_port = htons((uint16_t)port_value);
+		endpoint.len = sizeof(endpoint.addr.v4);
+	} else if (inet_pton(AF_INET6, host.c_str(),
+						 &endpoint.addr.v6.sin6_addr) == 1) {
+		endpoint.addr.v6.sin6_family = AF_INET6;
+		endpoint.addr.v6.sin6_port = htons((uint16_t)port_value);
+		endpoint.len = sizeof(endpoint.addr.v6);
+	} else {
+		return false;
+	}
+
+	*this = endpoint;
+	return true;
+}
+
+std::string Endpoint::to_string() const
+{
+	char buf[INET6_ADDRSTRLEN];
+
+	if (addr.sa.sa_family == AF_INET) {
+		if (inet_ntop(AF_INET, &addr.v4.sin_addr, buf, sizeof(buf)) ==
+			nullptr) {
+			return "";
+		}
+
+		return std::string(buf) + ":" +
+			   std::to_string(ntohs(addr.v4.sin_port));
+	}
+
+	if (addr.sa.sa_family == AF_INET6) {
+		if (inet_ntop(AF_INET6, &addr.v6.sin6_addr, buf, sizeof(buf)) ==
+			nullptr) {
+			return "";
+		}
+
+		return "[" + std::string(buf) + "]:" +
+			   std::to_string(ntohs(addr.v6.sin6_port));
+	}
+
+	return "";
+}
@@ -0,0 +1,114 @@
+#ifndef UCP_SRC_UCPENDPOINT_HPP_
+#define UCP_SRC_UCPENDPOINT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace ucp {
+
+/**
+ * @brief binary address of a peer, cheap to copy, compare and hash
+ * 
+ */
+struct Endpoint {
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in v4;
+		struct sockaddr_in6 v6;
+	} addr;
+	socklen_t len;
+
+	Endpoint()
+		: len(0)
+	{
+		memset(&addr, 0, sizeof(addr));
+	}
+
+	/**
+	 * @brief parse address
+	 * 
+	 * @param address "ip:port" or "[ipv6]:port"
+	 * @return true 
+	 * @return false if address is invalid
+	 */
+	bool parse(const std::string &address);
+
+	/**
+	 * @brief format as "ip:port" or "[ipv6]:port"
+	 * 
+	 * @return std::string empty if endpoint is empty
+	 */
+	std::string to_string() const;
+
+	bool empty() const
+	{
+		return len == 0;
+	}
+
+	size_t hash() const
+	{
+		if (addr.sa.sa_family == AF_INET) {
+			uint64_t key = ((uint64_t)addr.v4.sin_addr.s_addr << 16) |
+						   addr.v4.sin_port;
+			return std::hash<uint64_t>()(key);
+		}
+
+		if (addr.sa.sa_family == AF_INET6) {
+			// fnv-1a
+			uint64_t h = 14695981039346656037ull;
+			const unsigned char *p = addr.v6.sin6_addr.s6_addr;
+			for (int i = 0; i < 16; i++) {
+				h = (h ^ p[i]) * 1099511628211ull;
+			}
+			return (size_t)(h ^ addr.v6.sin6_port);
+		}
+
+		return 0;
+	}
+
+	bool operator==(const Endpoint &other) const
+	{
+		if (addr.sa.sa_family != other.addr.sa.sa_family) {
+			return false;
+		}
+
+		if (addr.sa.sa_family == AF_INET) {
+			return addr.v4.sin_port == other.addr.v4.sin_port &&
+				   addr.v4.sin_addr.s_addr == other.addr.v4.sin_addr.s_addr;
+		}
+
+		if (addr.sa.sa_family == AF_INET6) {
+			return addr.v6.sin6_port == other.addr.v6.sin6_port &&
+				   addr.v6.sin6_scope_id == other.addr.v6.sin6_scope_id &&
+				   memcmp(&addr.v6.sin6_addr, &other.addr.v6.sin6_addr,
+						  sizeof(addr.v6.sin6_addr)) == 0;
+		}
+
+		return len == other.len && memcmp(&addr, &other.addr, len) == 0;
+	}
+
+	bool operator!=(const Endpoint &other) const
+	{
+		return !(*this == other);
+	}
+};
+
+} // namespace ucp
+
+namespace std {
+template <>
+struct hash<ucp::Endpoint> {
+	size_t operator()(const ucp::Endpoint &endpoint) const
+	{
+		return endpoint.hash();
+	}
+};
+} // namespace std
+
+#endif // UCP_SRC_UCPENDPOINT_HPP_
@@ -0,0 +1,139 @@
+#include "ucpexecutor.hpp"
+
+#include <algorithm>
+
+using namespace ucp;
+
+namespace {
+
+// worker running on this thread
+thread_local const Executor *current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+Executor::Executor(size_t threads)
+	: next_(0)
+	, pending_(0)
+	, stopped_(false)
+{
+	if (threads == 0) {
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		workers_.push_back(std::make_unique<Worker>());
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		threads_.emplace_back(&Executor::run, this, i);
+	}
+}
+
+Executor::~Executor()
+{
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex_);
+		stopped_ = true;
+	}
+	idle_.notify_all();
+
+	for (auto &thread : threads_) {
+		thread.join();
+	}
+
+	// free tasks not run, their captures may hold sessions
+	for (auto &worker : workers_) {
+		worker->tasks.clear();
+	}
+}
+
+void Executor::post(std::function<void()> task)
+{
+	size_t index = current_executor == this
+					   ? current_worker
+					   : next_.fetch_add(1) % workers_.size();
+	push(index, std::move(task));
+}
+
+void Executor::post(uint32_t key, std::function<void()> task)
+{
+	push(key % workers_.size(), std::move(task));
+}
+
+Dispatcher Executor::dispatcher()
+{
+	return [this](uint32_t session_id, std::function<void()> task) {
+		post(session_id, std::move(task));
+	};
+}
+
+size_t Executor::size() const
+{
+	return workers_.size();
+}
+
+void Executor::push(size_t index, std::function<void()> task)
+{
+	if (stopped_) { // posted by a task while stopping, dropped
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+		workers_[index]->tasks.push_back(std::move(task));
+	}
+
+	// the lock orders the count with a worker going to sleep
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex_);
+		pending_++;
+	}
+	idle_.notify_one();
+}
+
+bool Executor::take(size_t index, std::function<void()> &task)
+{
+	for (size_t i = 0; i < workers_.size(); i++) {
+		Worker &worker = *workers_[(index + i) % workers_.size()];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (worker.tasks.empty()) {
+			continue;
+		}
+
+		if (i == 0) {
+			task = std::move(worker.tasks.front());
+			worker.tasks.pop_front();
+		} else {
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+		}
+
+		pending_--;
+		return true;
+	}
+
+	return false;
+}
+
+void Executor::run(size_t index)
+{
+	current_executor = this;
+	current_worker = index;
+
+	// stop between tasks, a task posting others can not hold the join
+	std::function<void()> task;
+	while (!stopped_) {
+		if (take(index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(idle_mutex_);
+		idle_.wait(lock, [this] { return stopped_ || pending_ > 0; });
+		if (stopped_) {
+			break;
+		}
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef UCP_SRC_UCPEXECUTOR_HPP_
+#define UCP_SRC_UCPEXECUTOR_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ucphandler.hpp"
+
+namespace ucp {
+
+/**
+ * @brief a pool of worker threads with one task queue each, idle workers
+ * steal from the others. tasks of a key go to the same worker unless it is
+ * busy, so handlers of a session keep their caches, and SessionHandler never
+ * runs two tasks of a session at once
+ *
+ */
+class Executor {
+public:
+	/**
+	 * @brief start workers
+	 *
+	 * @param threads 0 for the number of cores. with as many threads as
+	 * Server workers, sessions of a shard go to the same worker
+	 */
+	explicit Executor(size_t threads = 0);
+
+	/**
+	 * @brief stop workers after the tasks running, tasks not run yet and
+	 * posted meanwhile are dropped. the executor must outlive servers and
+	 * clients dispatching to it
+	 *
+	 */
+	~Executor();
+
+	Executor(const Executor &) = delete;
+	Executor &operator=(const Executor &) = delete;
+
+	/**
+	 * @brief run task on any worker, the current one if called by a worker
+	 *
+	 */
+	void post(std::function<void()> task);
+
+	/**
+	 * @brief run task on the worker of key, or a worker stealing it
+	 *
+	 * @param key e.g. session id
+	 * @param task
+	 */
+	void post(uint32_t key, std::function<void()> task);
+
+	/**
+	 * @brief get a dispatcher for handlers, keyed by session id
+	 *
+	 */
+	Dispatcher dispatcher();
+
+	size_t size() const;
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<std::function<void()> > tasks;
+	};
+
+	void run(size_t index);
+	void push(size_t index, std::function<void()> task);
+
+	// own tasks first in order, then steal the newest of others
+	bool take(size_t index, std::function<void()> &task);
+
+	std::vector<std::unique_ptr<Worker> > workers_;
+	std::vector<std::thread> threads_;
+	std::atomic<size_t> next_;
+
+	// idle workers sleep until a task is posted
+	std::mutex idle_mutex_;
+	std::condition_variable idle_;
+	// queued tasks, may be -1 while a task is taken before counted
+	std::atomic<int64_t> pending_;
+	std::atomic<bool> stopped_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPEXECUTOR_HPP_
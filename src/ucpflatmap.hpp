@@ -0,0 +1,179 @@
+#ifndef UCP_SRC_UCPFLATMAP_HPP_
+#define UCP_SRC_UCPFLATMAP_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ucp {
+
+/**
+ * @brief open addressing hash table keyed by uint32_t with linear probing,
+ * keys are stored apart from values so probing touches few cache lines,
+ * key 0 is reserved as empty
+ *
+ * @tparam T value type
+ */
+template <typename T>
+class FlatMap {
+public:
+	FlatMap()
+		: size_(0)
+		, shift_(32)
+	{
+		rehash(kMinCapacity);
+	}
+
+	/**
+	 * @brief find value of key
+	 *
+	 * @return T* nullptr if not found
+	 */
+	T *find(uint32_t key)
+	{
+		if (key == 0) {
+			return nullptr;
+		}
+
+		for (size_t i = slot_of(key);; i = (i + 1) & mask_) {
+			if (keys_[i] == key) {
+				return &values_[i];
+			}
+
+			if (keys_[i] == 0) {
+				return nullptr;
+			}
+		}
+	}
+
+	/**
+	 * @brief insert value of key
+	 *
+	 * @return true
+	 * @return false if key is 0 or exists
+	 */
+	bool insert(uint32_t key, T value)
+	{
+		if (key == 0 || find(key) != nullptr) {
+			return false;
+		}
+
+		// keep load factor under 3/4
+		if ((size_ + 1) * 4 > keys_.size() * 3) {
+			rehash(keys_.size() * 2);
+		}
+
+		place(key, std::move(value));
+		size_++;
+		return true;
+	}
+
+	/**
+	 * @brief erase key, entries after it are shifted back so no tombstone
+	 * is left
+	 *
+	 * @return true
+	 * @return false if not found
+	 */
+	bool erase(uint32_t key)
+	{
+		T *value = find(key);
+		if (value == nullptr) {
+			return false;
+		}
+
+		size_t hole = value - values_.data();
+		size_t i = hole;
+		while (true) {
+			i = (i + 1) & mask_;
+			if (keys_[i] == 0) {
+				break;
+			}
+
+			// move the entry into the hole if its home slot is not in
+			// (hole, i]
+			size_t home = slot_of(keys_[i]);
+			if (((i - home) & mask_) >= ((i - hole) & mask_)) {
+				keys_[hole] = keys_[i];
+				values_[hole] = std::move(values_[i]);
+				hole = i;
+			}
+		}
+
+		keys_[hole] = 0;
+		values_[hole] = T();
+		size_--;
+		return true;
+	}
+
+	/**
+	 * @brief call f(key, value) for each entry, f must not modify the map
+	 *
+	 */
+	template <typename F>
+	void for_each(F f)
+	{
+		for (size_t i = 0; i < keys_.size(); i++) {
+			if (keys_[i] != 0) {
+				f(keys_[i], values_[i]);
+			}
+		}
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+private:
+	static constexpr size_t kMinCapacity = 16;
+
+	// fibonacci hashing, session ids of a shard share the same residue so
+	// the low bits alone would cluster
+	size_t slot_of(uint32_t key) const
+	{
+		return (uint32_t)(key * 2654435769u) >> shift_;
+	}
+
+	void place(uint32_t key, T value)
+	{
+		size_t i = slot_of(key);
+		while (keys_[i] != 0) {
+			i = (i + 1) & mask_;
+		}
+
+		keys_[i] = key;
+		values_[i] = std::move(value);
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<uint32_t> keys(capacity, 0);
+		std::vector<T> values(capacity);
+		keys.swap(keys_);
+		values.swap(values_);
+
+		mask_ = capacity - 1;
+		shift_ = 32;
+		for (size_t n = capacity; n > 1; n >>= 1) {
+			shift_--;
+		}
+
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (keys[i] != 0) {
+				place(keys[i], std::move(values[i]));
+			}
+		}
+	}
+
+	std::vector<uint32_t> keys_;
+	std::vector<T> values_;
+	size_t size_;
+	size_t mask_;
+	unsigned shift_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPFLATMAP_HPP_
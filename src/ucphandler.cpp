@@ -0,0 +1,136 @@
+#include "ucphandler.hpp"
+
+using namespace ucp;
+
+SessionHandler::SessionHandler(std::shared_ptr<Session> session,
+							   uint32_t session_id,
+							   std::shared_ptr<const Handlers> handlers,
+							   Dispatcher dispatcher)
+	: session_(session)
+	, session_id_(session_id)
+	, handlers_(handlers)
+	, dispatcher_(dispatcher)
+	, readable_watched_(false)
+	, writable_watched_(false)
+	, pending_(0)
+	, running_(false)
+	, closed_(false)
+{
+}
+
+void SessionHandler::start(bool accepted)
+{
+	schedule(accepted ? kEventAccept : kEventStart);
+}
+
+void SessionHandler::schedule(int events)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_ |= events;
+		if (running_ || closed_) { // the running task takes the events
+			return;
+		}
+		running_ = true;
+	}
+
+	if (!dispatcher_) {
+		run();
+		return;
+	}
+
+	auto self = shared_from_this();
+	dispatcher_(session_id_, [self] { self->run(); });
+}
+
+void SessionHandler::run()
+{
+	int events;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		events = pending_;
+		pending_ = 0;
+	}
+
+	while (true) {
+		if ((events & kEventAccept) && handlers_->on_accept) {
+			handlers_->on_accept(session_);
+		}
+
+		if (events & kEventReadable) {
+			readable_watched_ = false;
+			if (!deliver_messages()) {
+				if (handlers_->on_close) {
+					handlers_->on_close(session_);
+				}
+
+				// watchers still set drop their events
+				std::lock_guard<std::mutex> lock(mutex_);
+				closed_ = true;
+				running_ = false;
+				return;
+			}
+		}
+
+		if (events & kEventWritable) {
+			writable_watched_ = false;
+			if (handlers_->on_writable) {
+				handlers_->on_writable(session_);
+			}
+		}
+
+		events = watch();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		events |= pending_;
+		pending_ = 0;
+		if (events == 0) {
+			running_ = false;
+			return;
+		}
+	}
+}
+
+bool SessionHandler::deliver_messages()
+{
+	// the receive queue holds at most a window of messages
+	while (true) {
+		MessageView view;
+		ssize_t size = session_->recv_view(view);
+		if (size < 0) {
+			return false;
+		}
+
+		if (size == 0) {
+			return true;
+		}
+
+		if (handlers_->on_message) {
+			handlers_->on_message(session_, view);
+		}
+	}
+}
+
+int SessionHandler::watch()
+{
+	int events = 0;
+	auto self = shared_from_this();
+
+	// readable also tells the session is closed
+	if (!readable_watched_) {
+		if (session_->when_readable(
+				[self] { self->schedule(kEventReadable); })) {
+			readable_watched_ = true;
+		} else {
+			events |= kEventReadable;
+		}
+	}
+
+	// already writable is no drain, nothing to tell
+	if (handlers_->on_writable && !writable_watched_) {
+		writable_watched_ = session_->when_writable(
+			[self] { self->schedule(kEventWritable); });
+	}
+
+	return events;
+}
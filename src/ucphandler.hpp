@@ -0,0 +1,119 @@
+#ifndef UCP_SRC_UCPHANDLER_HPP_
+#define UCP_SRC_UCPHANDLER_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "ucpbase.hpp"
+#include "ucploop.hpp"
+#include "ucpview.hpp"
+
+namespace ucp {
+
+/**
+ * @brief handlers of session events, pushed by the network threads instead
+ * of pulled by accept and recv. unset handlers are skipped
+ *
+ */
+struct Handlers {
+	// a new session on the server
+	std::function<void(std::shared_ptr<Session> session)> on_accept;
+
+	// a complete message, the view is released after the handler unless it
+	// is moved out. messages are dropped without the handler
+	std::function<void(std::shared_ptr<Session> session, MessageView &view)>
+		on_message;
+
+	// the send buffer drained below kUCPSendBufferWindows windows after a
+	// handler left it full
+	std::function<void(std::shared_ptr<Session> session)> on_writable;
+
+	// closed by either side or timed out, the last event of the session
+	std::function<void(std::shared_ptr<Session> session)> on_close;
+};
+
+/**
+ * @brief runs a task of handlers, e.g. posts it to EventLoop or a thread
+ * pool. tasks of one session are dispatched one at a time
+ *
+ * @param session_id id of the session on the server, 0 on the client
+ * @param task
+ */
+using Dispatcher =
+	std::function<void(uint32_t session_id, std::function<void()> task)>;
+
+/**
+ * @brief get a dispatcher running tasks on loop
+ *
+ */
+inline Dispatcher dispatch_on(EventLoop &loop)
+{
+	return [&loop](uint32_t, std::function<void()> task) {
+		loop.post(std::move(task));
+	};
+}
+
+/**
+ * @brief delivers events of a session to handlers, never running two
+ * handlers of the session at the same time
+ *
+ */
+class SessionHandler : public std::enable_shared_from_this<SessionHandler> {
+public:
+	SessionHandler() = delete;
+
+	/**
+	 * @param session
+	 * @param session_id passed to dispatcher
+	 * @param handlers
+	 * @param dispatcher nullptr to run handlers in the thread of the event,
+	 * a network thread or the thread closing the session
+	 */
+	SessionHandler(std::shared_ptr<Session> session, uint32_t session_id,
+				   std::shared_ptr<const Handlers> handlers,
+				   Dispatcher dispatcher);
+
+	/**
+	 * @brief start to watch the session
+	 *
+	 * @param accepted call on_accept first
+	 */
+	void start(bool accepted);
+
+private:
+	enum Event {
+		kEventStart = 1,
+		kEventAccept = 2,
+		kEventReadable = 4,
+		kEventWritable = 8,
+	};
+
+	void schedule(int events);
+	void run();
+
+	// return false if the session is closed
+	bool deliver_messages();
+
+	// watch the session again, return events which happened meanwhile
+	int watch();
+
+	std::shared_ptr<Session> session_;
+	uint32_t session_id_;
+	std::shared_ptr<const Handlers> handlers_;
+	Dispatcher dispatcher_;
+
+	// touched only by run
+	bool readable_watched_;
+	bool writable_watched_;
+
+	std::mutex mutex_;
+	int pending_;
+	bool running_;
+	bool closed_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPHANDLER_HPP_
@@ -0,0 +1,52 @@
+#include "ucploop.hpp"
+
+#include <chrono>
+
+using namespace ucp;
+
+EventLoop::EventLoop()
+	: stopped_(false)
+{
+}
+
+void EventLoop::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(tasks_mutex_);
+		tasks_.push_back(std::move(task));
+	}
+
+	reactor_.wakeup();
+}
+
+void EventLoop::run()
+{
+	while (!stopped_) {
+		if (poll() == 0) {
+			reactor_.wait(std::chrono::milliseconds::max());
+		}
+	}
+}
+
+size_t EventLoop::poll()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasks_mutex_);
+		running_.swap(tasks_);
+	}
+
+	// tasks posted meanwhile run in the next poll
+	size_t count = running_.size();
+	for (auto &task : running_) {
+		task();
+	}
+	running_.clear();
+
+	return count;
+}
+
+void EventLoop::stop()
+{
+	stopped_ = true;
+	reactor_.wakeup();
+}
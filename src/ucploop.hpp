@@ -0,0 +1,64 @@
+#ifndef UCP_SRC_UCPLOOP_HPP_
+#define UCP_SRC_UCPLOOP_HPP_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "ucpreactor.hpp"
+
+namespace ucp {
+
+/**
+ * @brief runs posted tasks on the thread calling run, e.g. to resume
+ * coroutines woken by the network threads. one loop serves any number of
+ * sessions
+ *
+ */
+class EventLoop {
+public:
+	EventLoop();
+	~EventLoop() = default;
+
+	EventLoop(const EventLoop &) = delete;
+	EventLoop &operator=(const EventLoop &) = delete;
+
+	/**
+	 * @brief queue task and wake up the loop, can be called from any thread
+	 *
+	 * @param task
+	 */
+	void post(std::function<void()> task);
+
+	/**
+	 * @brief run tasks until stop is called
+	 *
+	 */
+	void run();
+
+	/**
+	 * @brief run tasks queued so far without waiting
+	 *
+	 * @return size_t number of tasks run
+	 */
+	size_t poll();
+
+	/**
+	 * @brief make run return, can be called from any thread
+	 *
+	 */
+	void stop();
+
+private:
+	Reactor reactor_;
+	std::atomic<bool> stopped_;
+
+	std::mutex tasks_mutex_;
+	std::vector<std::function<void()> > tasks_;
+	std::vector<std::function<void()> > running_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPLOOP_HPP_
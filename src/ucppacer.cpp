@@ -0,0 +1,143 @@
+#include "ucppacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ucp;
+
+namespace {
+
+// the bucket holds this long of the rate, covers timer slack of the reactor
+constexpr uint64_t kBurstTime = 2000; // us
+
+// but never less than a few full packets
+constexpr uint64_t kMinBurst = 4 * kUCPMaxPacketSize;
+
+// slots are allocated on the first queued packet
+constexpr size_t kInitialSlots = 16;
+
+// packets queued at most, the oldest is sent at once beyond it
+constexpr size_t kMaxSlots = 4096;
+
+// 5/4 of window per rtt
+constexpr uint64_t kPacingGainNum = 5;
+constexpr uint64_t kPacingGainDen = 4;
+
+} // namespace
+
+Pacer::Pacer()
+	: rate_(0)
+	, burst_(kMinBurst)
+	, tokens_(kMinBurst)
+	, last_refill_(now_us())
+	, slots_()
+	, head_(0)
+	, count_(0)
+{
+}
+
+void Pacer::rate(uint64_t bytes_per_second)
+{
+	rate_ = bytes_per_second;
+	burst_ = std::max(kMinBurst, rate_ * kBurstTime / 1000000);
+	tokens_ = std::min(tokens_, (double)burst_);
+}
+
+uint64_t Pacer::rate() const
+{
+	return rate_;
+}
+
+std::chrono::milliseconds Pacer::next_release() const
+{
+	if (count_ == 0) {
+		return kUCPNoTimeout;
+	}
+
+	if (rate_ == 0) {
+		return std::chrono::milliseconds(0);
+	}
+
+	// tokens refilled since last_refill_ are counted by waiting less
+	double elapsed = now_us() - last_refill_;
+	double deficit = slots_[head_].size - tokens_ - elapsed * rate_ / 1e6;
+	if (deficit <= 0) {
+		return std::chrono::milliseconds(0);
+	}
+
+	return std::chrono::milliseconds(
+		(int64_t)std::ceil(deficit * 1000 / rate_));
+}
+
+size_t Pacer::size() const
+{
+	return count_;
+}
+
+uint64_t Pacer::now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+bool Pacer::take(size_t len, uint64_t now)
+{
+	if (rate_ == 0) {
+		return true;
+	}
+
+	if (now > last_refill_) {
+		tokens_ += (double)(now - last_refill_) * rate_ / 1e6;
+		tokens_ = std::min(tokens_, (double)burst_);
+	}
+	last_refill_ = now;
+
+	if (tokens_ < len) {
+		return false;
+	}
+
+	tokens_ -= len;
+	return true;
+}
+
+bool Pacer::grow()
+{
+	if (slots_.size() >= kMaxSlots) {
+		return false;
+	}
+
+	// unwrap the ring into a larger one
+	std::vector<Slot> slots(std::max(kInitialSlots, slots_.size() * 2));
+	for (size_t i = 0; i < count_; i++) {
+		const Slot &slot = slots_[(head_ + i) % slots_.size()];
+		slots[i].size = slot.size;
+		memcpy(slots[i].data, slot.data, slot.size);
+	}
+
+	slots_.swap(slots);
+	head_ = 0;
+	return true;
+}
+
+void Pacer::pop()
+{
+	head_ = (head_ + 1) % slots_.size();
+	count_--;
+}
+
+uint64_t ucp::kcp_pacing_rate(const ikcpcb *kcp)
+{
+	if (kcp->rx_srtt <= 0) {
+		return 0;
+	}
+
+	uint64_t window = std::min(kcp->snd_wnd, kcp->rmt_wnd);
+	if (kcp->nocwnd == 0 || kcp->cc != nullptr) {
+		window = std::min<uint64_t>(window, kcp->cwnd);
+	}
+
+	window = std::max<uint64_t>(window, 1);
+	return window * kcp->mss * 1000 * kPacingGainNum / kPacingGainDen /
+		   kcp->rx_srtt;
+}
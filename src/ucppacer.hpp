@@ -0,0 +1,135 @@
+#ifndef UCP_SRC_UCPPACER_HPP_
+#define UCP_SRC_UCPPACER_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ucpbase.hpp"
+#include "kcp/ikcp.h"
+
+namespace ucp {
+
+/**
+ * @brief token bucket between kcp output and the send queue. packets within
+ * the bucket go out at once, the rest wait in order until tokens refill at
+ * the pacing rate, so a flush opening a large window is spread over time
+ * instead of hitting the network in one burst. packets are in wire format
+ *
+ */
+class Pacer {
+public:
+	Pacer();
+
+	/**
+	 * @brief set pacing rate
+	 *
+	 * @param bytes_per_second 0 to send without pacing
+	 */
+	void rate(uint64_t bytes_per_second);
+	uint64_t rate() const;
+
+	/**
+	 * @brief send a packet of size bytes in pieces by output(iov, iovcnt)
+	 * if tokens allow, otherwise queue a copy of it
+	 *
+	 */
+	template <typename F>
+	void send(const struct iovec *iov, size_t iovcnt, size_t size, F output)
+	{
+		uint64_t now = now_us();
+		if (count_ == 0 && take(size, now)) {
+			output(iov, iovcnt);
+			return;
+		}
+
+		if (count_ == slots_.size() && !grow()) { // full, send the oldest
+			output_slot(output);
+		}
+
+		Slot &slot = slots_[(head_ + count_) % slots_.size()];
+		slot.size = gather_iovec(iov, iovcnt, slot.data, sizeof(slot.data));
+		if (slot.size == 0) { // too large for the wire, drop it
+			return;
+		}
+		count_++;
+
+		release(output);
+	}
+
+	/**
+	 * @brief send queued packets tokens allow by output(iov, iovcnt)
+	 *
+	 * @return size_t number of packets sent
+	 */
+	template <typename F>
+	size_t release(F output)
+	{
+		uint64_t now = now_us();
+		size_t sent = 0;
+		while (count_ > 0 && take(slots_[head_].size, now)) {
+			output_slot(output);
+			sent++;
+		}
+
+		return sent;
+	}
+
+	/**
+	 * @brief get time until the next queued packet can be sent
+	 *
+	 * @return std::chrono::milliseconds kUCPNoTimeout if nothing queued
+	 */
+	std::chrono::milliseconds next_release() const;
+
+	size_t size() const;
+
+private:
+	struct Slot {
+		size_t size;
+		char data[kUCPMaxPacketSize];
+	};
+
+	// send the oldest queued packet
+	template <typename F>
+	void output_slot(F output)
+	{
+		Slot &slot = slots_[head_];
+		struct iovec iov;
+		iov.iov_base = slot.data;
+		iov.iov_len = slot.size;
+		output(&iov, 1);
+		pop();
+	}
+
+	static uint64_t now_us();
+
+	// refill the bucket and take len bytes from it
+	bool take(size_t len, uint64_t now);
+	bool grow();
+	void pop();
+
+	uint64_t rate_;
+	uint64_t burst_;
+	double tokens_;
+	uint64_t last_refill_;
+
+	// ring of queued packets
+	std::vector<Slot> slots_;
+	size_t head_;
+	size_t count_;
+};
+
+/**
+ * @brief get pacing rate from the window kcp may send in a round and the
+ * smoothed rtt, with some headroom so the window can still grow
+ *
+ * @return uint64_t bytes per second, 0 if no rtt sample yet
+ */
+uint64_t kcp_pacing_rate(const ikcpcb *kcp);
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPPACER_HPP_
@@ -0,0 +1,135 @@
+#include "ucppath.hpp"
+
+#include <cstring>
+#include <random>
+
+#include "ucpbase.hpp"
+
+using namespace ucp;
+
+namespace {
+
+inline uint64_t rotl(uint64_t x, int b)
+{
+	return (x << b) | (x >> (64 - b));
+}
+
+inline void sip_round(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3)
+{
+	v0 += v1;
+	v1 = rotl(v1, 13);
+	v1 ^= v0;
+	v0 = rotl(v0, 32);
+	v2 += v3;
+	v3 = rotl(v3, 16);
+	v3 ^= v2;
+	v0 += v3;
+	v3 = rotl(v3, 21);
+	v3 ^= v0;
+	v2 += v1;
+	v1 = rotl(v1, 17);
+	v1 ^= v2;
+	v2 = rotl(v2, 32);
+}
+
+// siphash-2-4, words are read in host order as only this server checks them
+uint64_t siphash(const uint64_t key[2], const unsigned char *data, size_t size)
+{
+	uint64_t v0 = key[0] ^ 0x736f6d6570736575ull;
+	uint64_t v1 = key[1] ^ 0x646f72616e646f6dull;
+	uint64_t v2 = key[0] ^ 0x6c7967656e657261ull;
+	uint64_t v3 = key[1] ^ 0x7465646279746573ull;
+
+	size_t tail = size % 8;
+	const unsigned char *end = data + size - tail;
+	for (; data != end; data += 8) {
+		uint64_t m;
+		memcpy(&m, data, sizeof(m));
+		v3 ^= m;
+		sip_round(v0, v1, v2, v3);
+		sip_round(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	uint64_t last = (uint64_t)size << 56;
+	for (size_t i = 0; i < tail; i++) {
+		last |= (uint64_t)data[i] << (8 * i);
+	}
+
+	v3 ^= last;
+	sip_round(v0, v1, v2, v3);
+	sip_round(v0, v1, v2, v3);
+	v0 ^= last;
+
+	v2 ^= 0xff;
+	for (int i = 0; i < 4; i++) {
+		sip_round(v0, v1, v2, v3);
+	}
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+} // namespace
+
+PathValidator::PathValidator()
+{
+	std::random_device random;
+	for (auto &key : key_) {
+		key = ((uint64_t)random() << 32) | random();
+	}
+}
+
+uint64_t PathValidator::token(uint32_t session_id, const Endpoint &endpoint,
+							  std::chrono::steady_clock::time_point now) const
+{
+	return token(session_id, endpoint, bucket(now));
+}
+
+bool PathValidator::validate(uint32_t session_id, const Endpoint &endpoint,
+							 uint64_t token,
+							 std::chrono::steady_clock::time_point now) const
+{
+	// a challenge sent just before the bucket turned is still answered
+	uint64_t current = bucket(now);
+	return token == this->token(session_id, endpoint, current) ||
+		   (current > 0 &&
+			token == this->token(session_id, endpoint, current - 1));
+}
+
+uint64_t PathValidator::token(uint32_t session_id, const Endpoint &endpoint,
+							  uint64_t bucket) const
+{
+	// only the fields compared by Endpoint::operator==, not the padding
+	unsigned char data[sizeof(bucket) + sizeof(session_id) + 2 + 2 + 16 + 4];
+	size_t size = 0;
+	auto append = [&data, &size](const void *field, size_t field_size) {
+		memcpy(data + size, field, field_size);
+		size += field_size;
+	};
+
+	append(&bucket, sizeof(bucket));
+	append(&session_id, sizeof(session_id));
+	uint16_t family = endpoint.addr.sa.sa_family;
+	append(&family, sizeof(family));
+	if (family == AF_INET) {
+		append(&endpoint.addr.v4.sin_port, sizeof(endpoint.addr.v4.sin_port));
+		append(&endpoint.addr.v4.sin_addr, sizeof(endpoint.addr.v4.sin_addr));
+	} else if (family == AF_INET6) {
+		append(&endpoint.addr.v6.sin6_port,
+			   sizeof(endpoint.addr.v6.sin6_port));
+		append(&endpoint.addr.v6.sin6_addr,
+			   sizeof(endpoint.addr.v6.sin6_addr));
+		append(&endpoint.addr.v6.sin6_scope_id,
+			   sizeof(endpoint.addr.v6.sin6_scope_id));
+	}
+
+	return siphash(key_, data, size);
+}
+
+uint64_t PathValidator::bucket(std::chrono::steady_clock::time_point now) const
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			   now.time_since_epoch())
+			   .count() /
+		   kUCPPathTokenLifetime.count();
+}
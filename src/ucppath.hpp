@@ -0,0 +1,52 @@
+#ifndef UCP_SRC_UCPPATH_HPP_
+#define UCP_SRC_UCPPATH_HPP_
+
+#include <chrono>
+#include <cstdint>
+
+#include "ucpendpoint.hpp"
+
+namespace ucp {
+
+/**
+ * @brief stateless tokens of path challenges, a keyed hash of a secret of the
+ * server, the session id, the new endpoint and a coarse time bucket. any
+ * number of paths of a session may be challenged at once, the response of
+ * one validates it without the others, and a sender off the path can not
+ * forge it
+ *
+ */
+class PathValidator {
+public:
+	// with a random secret
+	PathValidator();
+
+	/**
+	 * @brief token to send in a path challenge to endpoint
+	 *
+	 */
+	uint64_t token(uint32_t session_id, const Endpoint &endpoint,
+				   std::chrono::steady_clock::time_point now) const;
+
+	/**
+	 * @brief check the token echoed in a path response from endpoint
+	 *
+	 * @return true if it was sent to endpoint for the session in this or the
+	 * previous time bucket
+	 * @return false if forged or expired
+	 */
+	bool validate(uint32_t session_id, const Endpoint &endpoint,
+				  uint64_t token,
+				  std::chrono::steady_clock::time_point now) const;
+
+private:
+	uint64_t token(uint32_t session_id, const Endpoint &endpoint,
+				   uint64_t bucket) const;
+	uint64_t bucket(std::chrono::steady_clock::time_point now) const;
+
+	uint64_t key_[2];
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPPATH_HPP_
@@ -0,0 +1,312 @@
+#include "ucppool.hpp"
+#include "ucpbase.hpp"
+#include "kcp/ikcp.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <sys/mman.h>
+
+using namespace ucp;
+
+namespace {
+
+// header before each block, keeps blocks 16 bytes aligned
+constexpr size_t kHeaderSize = 16;
+
+// IKCP_OVERHEAD of ikcp.c
+constexpr size_t kKcpOverhead = 24;
+
+// a full segment, the hot class
+constexpr size_t kSegmentSize =
+	(sizeof(IKCPSEG) + kUCPKcpMtu - kKcpOverhead + 63) & ~(size_t)63;
+
+constexpr size_t kClassSizes[] = { 64, 128, 256, 512, kSegmentSize, 2048,
+								   4096 };
+
+constexpr size_t kClassCount = sizeof(kClassSizes) / sizeof(kClassSizes[0]);
+
+static_assert(kSegmentSize > 512 && kSegmentSize < 2048,
+			  "segment class out of order");
+
+constexpr uint32_t kLargeClass = 0xffffffff;
+
+constexpr size_t kSlabSize = 64 * 1024;
+constexpr size_t kHugeSlabSize = 2 * 1024 * 1024;
+
+// blocks moved between a thread cache and the shared list at once
+constexpr size_t kBatchSize = 32;
+
+// max blocks of a class cached by a thread
+constexpr size_t kCacheLimit = 128;
+
+struct FreeBlock {
+	FreeBlock *next;
+};
+
+struct SharedList {
+	std::mutex mutex;
+	FreeBlock *head = nullptr;
+	size_t count = 0;
+};
+
+struct Shared {
+	SharedList lists[kClassCount];
+	std::atomic<bool> huge_pages{ false };
+
+	std::atomic<uint64_t> allocs{ 0 };
+	std::atomic<uint64_t> frees{ 0 };
+	std::atomic<uint64_t> large_allocs{ 0 };
+	std::atomic<uint64_t> refills{ 0 };
+	std::atomic<uint64_t> slab_bytes{ 0 };
+	std::atomic<uint64_t> huge_slabs{ 0 };
+};
+
+// never destroyed, blocks may be freed during static destruction
+Shared &shared()
+{
+	static Shared *instance = new Shared();
+	return *instance;
+}
+
+struct ThreadCache {
+	FreeBlock *head[kClassCount];
+	size_t count[kClassCount];
+	bool registered;
+	bool exited;
+};
+
+// trivially destructible, still usable after the guard below runs
+thread_local ThreadCache cache;
+
+void flush_cache();
+
+// returns cached blocks to the shared lists when the thread exits
+struct CacheGuard {
+	~CacheGuard()
+	{
+		flush_cache();
+		cache.exited = true;
+	}
+
+	void touch()
+	{
+	}
+};
+
+thread_local CacheGuard guard;
+
+size_t class_of(size_t size)
+{
+	for (size_t i = 0; i < kClassCount; i++) {
+		if (size <= kClassSizes[i]) {
+			return i;
+		}
+	}
+
+	return kClassCount;
+}
+
+void *map_slab(size_t &size)
+{
+	if (shared().huge_pages) {
+		size = kHugeSlabSize;
+		void *slab = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+						  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (slab != MAP_FAILED) {
+			shared().huge_slabs.fetch_add(1, std::memory_order_relaxed);
+			return slab;
+		}
+
+		// no reserved huge pages, ask for transparent ones
+		slab = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (slab == MAP_FAILED) {
+			return nullptr;
+		}
+
+		madvise(slab, size, MADV_HUGEPAGE);
+		return slab;
+	}
+
+	size = kSlabSize;
+	void *slab = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+					  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return slab == MAP_FAILED ? nullptr : slab;
+}
+
+// carve a new slab into the shared list, called with the list locked
+bool grow(size_t size_class, SharedList &list)
+{
+	size_t size;
+	char *slab = (char *)map_slab(size);
+	if (slab == nullptr) {
+		return false;
+	}
+
+	shared().slab_bytes.fetch_add(size, std::memory_order_relaxed);
+
+	size_t stride = kHeaderSize + kClassSizes[size_class];
+	for (size_t offset = 0; offset + stride <= size; offset += stride) {
+		*(uint32_t *)(slab + offset) = (uint32_t)size_class;
+
+		FreeBlock *block = (FreeBlock *)(slab + offset + kHeaderSize);
+		block->next = list.head;
+		list.head = block;
+		list.count++;
+	}
+
+	return true;
+}
+
+bool refill(size_t size_class)
+{
+	if (!cache.registered && !cache.exited) {
+		guard.touch();
+		cache.registered = true;
+	}
+
+	SharedList &list = shared().lists[size_class];
+	std::lock_guard<std::mutex> lock(list.mutex);
+	if (list.head == nullptr && !grow(size_class, list)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < kBatchSize && list.head != nullptr; i++) {
+		FreeBlock *block = list.head;
+		list.head = block->next;
+		list.count--;
+
+		block->next = cache.head[size_class];
+		cache.head[size_class] = block;
+		cache.count[size_class]++;
+	}
+
+	shared().refills.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void spill(size_t size_class, size_t count)
+{
+	SharedList &list = shared().lists[size_class];
+	std::lock_guard<std::mutex> lock(list.mutex);
+	for (size_t i = 0; i < count && cache.head[size_class] != nullptr; i++) {
+		FreeBlock *block = cache.head[size_class];
+		cache.head[size_class] = block->next;
+		cache.count[size_class]--;
+
+		block->next = list.head;
+		list.head = block;
+		list.count++;
+	}
+}
+
+void flush_cache()
+{
+	for (size_t i = 0; i < kClassCount; i++) {
+		spill(i, cache.count[i]);
+	}
+}
+
+void *alloc_hook(size_t size)
+{
+	return Pool::alloc(size);
+}
+
+void free_hook(void *ptr)
+{
+	Pool::free(ptr);
+}
+
+} // namespace
+
+void Pool::install()
+{
+	static std::once_flag flag;
+	std::call_once(flag, []() { ikcp_allocator(alloc_hook, free_hook); });
+}
+
+void Pool::use_huge_pages(bool enable)
+{
+	shared().huge_pages = enable;
+}
+
+void *Pool::alloc(size_t size)
+{
+	size_t size_class = class_of(size);
+	if (size_class == kClassCount) {
+		char *block = (char *)malloc(kHeaderSize + size);
+		if (block == nullptr) {
+			return nullptr;
+		}
+
+		*(uint32_t *)block = kLargeClass;
+		shared().large_allocs.fetch_add(1, std::memory_order_relaxed);
+		return block + kHeaderSize;
+	}
+
+	if (cache.head[size_class] == nullptr && !refill(size_class)) {
+		return nullptr;
+	}
+
+	FreeBlock *block = cache.head[size_class];
+	cache.head[size_class] = block->next;
+	cache.count[size_class]--;
+
+	shared().allocs.fetch_add(1, std::memory_order_relaxed);
+	return block;
+}
+
+void Pool::free(void *ptr)
+{
+	if (ptr == nullptr) {
+		return;
+	}
+
+	char *block = (char *)ptr - kHeaderSize;
+	uint32_t size_class = *(uint32_t *)block;
+	if (size_class == kLargeClass) {
+		::free(block);
+		return;
+	}
+
+	shared().frees.fetch_add(1, std::memory_order_relaxed);
+
+	if (cache.exited) { // thread is exiting, no cache
+		FreeBlock *free_block = (FreeBlock *)ptr;
+		SharedList &list = shared().lists[size_class];
+		std::lock_guard<std::mutex> lock(list.mutex);
+		free_block->next = list.head;
+		list.head = free_block;
+		list.count++;
+		return;
+	}
+
+	if (!cache.registered) {
+		guard.touch();
+		cache.registered = true;
+	}
+
+	FreeBlock *free_block = (FreeBlock *)ptr;
+	free_block->next = cache.head[size_class];
+	cache.head[size_class] = free_block;
+	cache.count[size_class]++;
+
+	if (cache.count[size_class] > kCacheLimit) {
+		spill(size_class, kCacheLimit / 2);
+	}
+}
+
+PoolStats Pool::stats()
+{
+	Shared &s = shared();
+
+	PoolStats stats;
+	stats.allocs = s.allocs.load(std::memory_order_relaxed);
+	stats.frees = s.frees.load(std::memory_order_relaxed);
+	stats.large_allocs = s.large_allocs.load(std::memory_order_relaxed);
+	stats.refills = s.refills.load(std::memory_order_relaxed);
+	stats.slab_bytes = s.slab_bytes.load(std::memory_order_relaxed);
+	stats.huge_slabs = s.huge_slabs.load(std::memory_order_relaxed);
+	return stats;
+}
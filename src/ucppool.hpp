@@ -0,0 +1,59 @@
+#ifndef UCP_SRC_UCPPOOL_HPP_
+#define UCP_SRC_UCPPOOL_HPP_
+
+// only support linux
+#ifndef __linux__
+#error "only support linux"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ucp {
+
+struct PoolStats {
+	uint64_t allocs; // blocks allocated from the pool
+	uint64_t frees; // blocks returned to the pool
+	uint64_t large_allocs; // too large for any class, from malloc
+	uint64_t refills; // thread caches refilled from the shared lists
+	uint64_t slab_bytes; // memory reserved by slabs
+	uint64_t huge_slabs; // slabs backed by huge pages
+};
+
+/**
+ * @brief size classed pool for kcp segments and buffers, installed by
+ * ikcp_allocator. blocks are carved from slabs, each thread caches freed
+ * blocks and trades them with the shared lists in batches. slabs are never
+ * released
+ *
+ */
+class Pool {
+public:
+	/**
+	 * @brief install the pool as kcp allocator, called before the first kcp
+	 * of ucp is created, later calls do nothing
+	 *
+	 */
+	static void install();
+
+	/**
+	 * @brief back slabs with huge pages, falls back to normal pages if huge
+	 * pages are not available, must be called before install
+	 *
+	 * @param enable
+	 */
+	static void use_huge_pages(bool enable);
+
+	static void *alloc(size_t size);
+	static void free(void *ptr);
+
+	/**
+	 * @brief get counters, updated with relaxed order
+	 *
+	 */
+	static PoolStats stats();
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPPOOL_HPP_
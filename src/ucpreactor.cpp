@@ -0,0 +1,109 @@
+#include "ucpreactor.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace ucp;
+
+Reactor::Reactor()
+	: wakeup_pending_(false)
+{
+	epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd_ == -1) {
+		throw std::runtime_error("create epoll failed");
+	}
+
+	event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (event_fd_ == -1) {
+		::close(epoll_fd_);
+		throw std::runtime_error("create eventfd failed");
+	}
+
+	if (!add(event_fd_)) {
+		::close(event_fd_);
+		::close(epoll_fd_);
+		throw std::runtime_error("epoll_ctl failed");
+	}
+}
+
+Reactor::~Reactor()
+{
+	::close(event_fd_);
+	::close(epoll_fd_);
+}
+
+bool Reactor::add(int fd)
+{
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+
+	return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+void Reactor::wakeup()
+{
+	// only the first wakeup since last wait needs to write eventfd
+	if (wakeup_pending_.exchange(true)) {
+		return;
+	}
+
+	uint64_t one = 1;
+	ssize_t ret = write(event_fd_, &one, sizeof(one));
+	(void)ret;
+}
+
+int Reactor::wait(std::chrono::milliseconds timeout)
+{
+	int timeout_ms = -1;
+	if (timeout != std::chrono::milliseconds::max()) {
+		timeout_ms = (int)std::min<std::chrono::milliseconds::rep>(
+			std::max<std::chrono::milliseconds::rep>(timeout.count(), 0),
+			INT_MAX);
+	}
+
+	struct epoll_event events[8];
+	int ret = epoll_wait(epoll_fd_, events, 8, timeout_ms);
+	if (ret < 0) {
+		return errno == EINTR ? 0 : -1;
+	}
+
+	for (int i = 0; i < ret; i++) {
+		if (events[i].data.fd == event_fd_) {
+			uint64_t value;
+			ssize_t n = read(event_fd_, &value, sizeof(value));
+			(void)n;
+			wakeup_pending_.store(false);
+		}
+	}
+
+	return ret;
+}
+
+ReadyQueue::ReadyQueue(std::shared_ptr<Reactor> reactor)
+	: reactor_(reactor)
+{
+}
+
+void ReadyQueue::push(uint32_t id)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		ids_.push_back(id);
+	}
+
+	reactor_->wakeup();
+}
+
+void ReadyQueue::take(std::vector<uint32_t> &ids)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	ids.insert(ids.end(), ids_.begin(), ids_.end());
+	ids_.clear();
+}
@@ -0,0 +1,91 @@
+#ifndef UCP_SRC_UCPREACTOR_HPP_
+#define UCP_SRC_UCPREACTOR_HPP_
+
+// only support linux
+#ifndef __linux__
+#error "only support linux"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ucp {
+
+/**
+ * @brief wait for socket readable, wakeup from other threads or timeout
+ * 
+ */
+class Reactor {
+public:
+	Reactor();
+	~Reactor();
+
+	Reactor(const Reactor &) = delete;
+	Reactor &operator=(const Reactor &) = delete;
+
+	/**
+	 * @brief watch fd for readable
+	 * 
+	 * @param fd 
+	 * @return true 
+	 * @return false 
+	 */
+	bool add(int fd);
+
+	/**
+	 * @brief wake up the thread blocked in wait, can be called from any
+	 * thread
+	 * 
+	 */
+	void wakeup();
+
+	/**
+	 * @brief wait until a watched fd is readable, wakeup is called or timeout
+	 * 
+	 * @param timeout std::chrono::milliseconds::max() to wait forever
+	 * @return int number of events, 0 if timeout, -1 if error
+	 */
+	int wait(std::chrono::milliseconds timeout);
+
+private:
+	int epoll_fd_;
+	int event_fd_;
+	std::atomic<bool> wakeup_pending_;
+};
+
+/**
+ * @brief ids of sessions which need attention of the reactor thread, filled
+ * by application threads
+ * 
+ */
+class ReadyQueue {
+public:
+	ReadyQueue(std::shared_ptr<Reactor> reactor);
+
+	/**
+	 * @brief queue id and wake up the reactor
+	 * 
+	 * @param id 
+	 */
+	void push(uint32_t id);
+
+	/**
+	 * @brief take all queued ids
+	 * 
+	 * @param ids queued ids are appended to it
+	 */
+	void take(std::vector<uint32_t> &ids);
+
+private:
+	std::shared_ptr<Reactor> reactor_;
+	std::mutex mutex_;
+	std::vector<uint32_t> ids_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPREACTOR_HPP_
@@ -1,5 +1,6 @@
 #include "ucpserver.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <cstdio>
@@ -8,39 +9,88 @@
 
 #include "kcp/ikcp.h"
 #include "ucpbase.hpp"
+#include "ucppool.hpp"
 
 using namespace ucp;
 
+namespace {
+
+void pop_accepted(std::shared_ptr<AcceptQueue> queue,
+				  std::function<void(std::shared_ptr<Session>)> callback)
+{
+	queue->pop([queue, callback](std::shared_ptr<ServerConnection> connection) {
+		// a session may time out while queued, take the next then
+		if (connection != nullptr && !connection->accept()) {
+			pop_accepted(queue, callback);
+			return;
+		}
+
+		callback(connection);
+	});
+}
+
+// start handlers of accepted sessions until the server exits
+void accept_to_handlers(std::shared_ptr<ServerInternel> internel,
+						std::shared_ptr<const Handlers> handlers,
+						Dispatcher dispatcher)
+{
+	internel->async_accept([internel, handlers, dispatcher](
+		std::shared_ptr<Session> session) {
+		if (session == nullptr) {
+			return;
+		}
+
+		auto connection = std::static_pointer_cast<ServerConnection>(session);
+		std::make_shared<SessionHandler>(session, connection->session_id(),
+										 handlers, dispatcher)
+			->start(true);
+		accept_to_handlers(internel, handlers, dispatcher);
+	});
+}
+
+} // namespace
+
 void ServerInternel::monitor_thread_func(
 	std::shared_ptr<Sock> sock, std::shared_ptr<ServerInternel> internel)
 {
+	auto local = internel->shards_[0];
+	bool has_fd = sock->fd() != -1 && local->reactor_->add(sock->fd());
+
 	while (true) {
+		Status status;
 		{
 			std::lock_guard<std::mutex> lock(internel->status_mutex_);
-			if (internel->status_ == kInit) {
-				internel->status_ = tranfer_status_from_init(sock, internel);
-			} else if (internel->status_ == kListen) {
-				std::lock_guard<std::mutex> lock(internel->connections_mutex_);
-				internel->status_ = tranfer_status_from_listen(sock, internel);
-
-				{
-					for (auto it = internel->connections_.begin();
-						 it != internel->connections_.end();) {
-						if (!it->second->kcp_update()) {
-							internel->connections_.erase(it++);
-						} else {
-							++it;
-						}
-					}
-				}
-			} else if (internel->status_ == kClosed) {
-				break;
-			} else if (internel->status_ == kExit) {
-				break;
+			status = internel->status_;
+		}
+
+		// the tick runs without status_mutex_ like the other shards, so api
+		// calls do not wait for it and handlers may call the server
+		std::chrono::milliseconds timeout = kUCPNoTimeout;
+		Status new_status = status;
+		if (status == kInit) {
+			new_status = tranfer_status_from_init(sock, internel);
+		} else if (status == kListen) {
+			new_status = tranfer_status_from_listen(internel);
+			timeout = local->poll();
+		} else if (status == kClosed) {
+			break;
+		} else if (status == kExit) {
+			break;
+		}
+
+		if (new_status != status) {
+			// exit may have been called meanwhile, keep it
+			std::lock_guard<std::mutex> lock(internel->status_mutex_);
+			if (internel->status_ == status) {
+				internel->status_ = new_status;
 			}
 		}
 
-		std::this_thread::sleep_for(kUCPDefaultInterval);
+		if (!has_fd) { // can not wait for socket, poll it
+			timeout = std::min(timeout, kUCPDefaultInterval);
+		}
+
+		local->reactor_->wait(timeout);
 	}
 }
 
@@ -51,101 +101,662 @@ Status ServerInternel::tranfer_status_from_init(
 }
 
 Status ServerInternel::tranfer_status_from_listen(
-	std::shared_ptr<Sock> sock, std::shared_ptr<ServerInternel> internel)
+	std::shared_ptr<ServerInternel> internel)
 {
-	Message msg;
-	std::string address;
-	ssize_t ret = sock->recv_from(&msg, sizeof(msg), address);
-
-	if (ret == -1) {
+	if (!internel->shards_[0]->ingest(internel->shards_,
+									  internel->ingest_budget_)) {
 		return kExit;
 	}
 
-	if (ret == 0) { // no data
-		return kListen;
+	return kListen;
+}
+
+ServerInternel::ServerInternel(const std::vector<std::shared_ptr<Sock> > &socks,
+							   size_t workers)
+	: status_(kInit)
+	, ingest_budget_(kUCPDefaultIngestBudget)
+	, sock_per_shard_(false)
+	, accept_queue_(std::make_shared<AcceptQueue>(kUCPDefaultAcceptBacklog))
+	, path_validator_(std::make_shared<PathValidator>())
+{
+	if (workers == 0) {
+		workers = 1;
 	}
 
-	if (ret != sizeof(msg)) { // error
-		return kExit;
+	sock_per_shard_ = workers > 1 && socks.size() == workers;
+	for (size_t i = 0; i < workers; i++) {
+		auto sock = sock_per_shard_ ? socks[i] : socks[0];
+		shards_.push_back(std::make_shared<ServerShard>(
+			i, workers, sock, sock_per_shard_, accept_queue_,
+			path_validator_));
+	}
+}
+
+void ServerInternel::async_accept(
+	std::function<void(std::shared_ptr<Session>)> callback)
+{
+	bool listening;
+	{
+		std::lock_guard<std::mutex> lock(status_mutex_);
+		listening = status_ == kListen;
+	}
+
+	if (!listening) {
+		callback(nullptr);
+		return;
+	}
+
+	// the queue is closed if the server exits meanwhile
+	pop_accepted(accept_queue_, std::move(callback));
+}
+
+bool ServerInternel::handlers(std::shared_ptr<const Handlers> handlers,
+							  Dispatcher dispatcher)
+{
+	{
+		std::lock_guard<std::mutex> lock(status_mutex_);
+		if (status_ != kListen) {
+			return false;
+		}
+	}
+
+	// sessions queued before are taken here, not one callback deep each
+	while (true) {
+		auto connection =
+			accept_queue_->pop(std::chrono::steady_clock::now());
+		if (connection == nullptr) {
+			break;
+		}
+
+		if (connection->accept()) {
+			std::make_shared<SessionHandler>(connection,
+											 connection->session_id(),
+											 handlers, dispatcher)
+				->start(true);
+		}
+	}
+
+	accept_to_handlers(shared_from_this(), handlers, dispatcher);
+	return true;
+}
+
+void ServerInternel::exit()
+{
+	{
+		std::lock_guard<std::mutex> lock(status_mutex_);
+		status_ = kExit;
+	}
+
+	// watchers of sessions and callbacks of async_accept may call the server
+	for (auto &shard : shards_) {
+		shard->stop();
+	}
+	accept_queue_->close();
+}
+
+void ServerInternel::worker_thread_func(std::shared_ptr<ServerInternel> internel,
+										size_t index)
+{
+	auto shard = internel->shards_[index];
+
+	// without its own sock, packets are dispatched by the monitor thread
+	std::shared_ptr<Sock> sock =
+		internel->sock_per_shard_ ? shard->sock_ : nullptr;
+	bool has_fd = sock == nullptr ||
+				  (sock->fd() != -1 && shard->reactor_->add(sock->fd()));
+
+	while (shard->running()) {
+		if (sock != nullptr &&
+			!shard->ingest(internel->shards_, internel->ingest_budget_)) {
+			break;
+		}
+
+		std::chrono::milliseconds timeout = shard->poll();
+		if (!has_fd) { // can not wait for socket, poll it
+			timeout = std::min(timeout, kUCPDefaultInterval);
+		}
+
+		shard->reactor_->wait(timeout);
+	}
+}
+
+AcceptQueue::AcceptQueue(size_t backlog)
+	: backlog_(backlog)
+	, closed_(false)
+{
+}
+
+void AcceptQueue::backlog(size_t backlog)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	backlog_ = backlog;
+}
+
+bool AcceptQueue::full()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return closed_ || queue_.size() >= backlog_;
+}
+
+bool AcceptQueue::push(
+	std::shared_ptr<ServerConnection> connection,
+	std::function<void(std::shared_ptr<ServerConnection>)> &waiter)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (closed_ || queue_.size() >= backlog_) {
+		return false;
+	}
+
+	if (!waiters_.empty()) {
+		waiter = std::move(waiters_.front());
+		waiters_.pop_front();
+		return true;
+	}
+
+	queue_.push_back(connection);
+	cv_.notify_one();
+	return true;
+}
+
+std::shared_ptr<ServerConnection>
+AcceptQueue::pop(std::chrono::steady_clock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	wait_until_deadline(cv_, lock, deadline,
+						[this] { return closed_ || !queue_.empty(); });
+	if (closed_ || queue_.empty()) {
+		return nullptr;
+	}
+
+	auto connection = queue_.front();
+	queue_.pop_front();
+	return connection;
+}
+
+void AcceptQueue::pop(
+	std::function<void(std::shared_ptr<ServerConnection>)> callback)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!closed_ && queue_.empty()) {
+		waiters_.push_back(std::move(callback));
+		return;
+	}
+
+	std::shared_ptr<ServerConnection> connection;
+	if (!closed_) {
+		connection = queue_.front();
+		queue_.pop_front();
+	}
+	lock.unlock();
+
+	callback(connection);
+}
+
+void AcceptQueue::close()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	closed_ = true;
+	queue_.clear();
+	cv_.notify_all();
+
+	auto waiters = std::move(waiters_);
+	waiters_.clear();
+	lock.unlock();
+
+	for (auto &callback : waiters) {
+		callback(nullptr);
+	}
+}
+
+ServerShard::ServerShard(size_t index, size_t count,
+						 std::shared_ptr<Sock> sock, bool sock_per_shard,
+						 std::shared_ptr<AcceptQueue> accept_queue,
+						 std::shared_ptr<const PathValidator> path_validator)
+	: sock_(sock)
+	, reactor_(std::make_shared<Reactor>())
+	, index_(index)
+	, count_(count)
+	, sock_per_shard_(sock_per_shard)
+	, running_(true)
+	, path_validator_(path_validator)
+	, send_queue_(std::make_shared<SendQueue>(sock))
+	, ready_queue_(std::make_shared<ReadyQueue>(reactor_))
+	, accept_queue_(accept_queue)
+	, timers_(steady_clock_ms())
+{
+	if (sock_per_shard_ || index_ == 0) { // reads a sock
+		recv_packets_.resize(kUCPBatchSize);
+		dispatched_.resize(count_, false);
+	}
+}
+
+bool ServerShard::ingest(
+	const std::vector<std::shared_ptr<ServerShard> > &shards, size_t budget)
+{
+	size_t received = 0;
+	size_t count;
+	while ((count = ingest_batch_size(received, budget)) > 0) {
+		ssize_t ret = sock_->recv_batch(recv_packets_.data(), count);
+
+		if (ret == -1) {
+			return false;
+		}
+
+		for (ssize_t i = 0; i < ret; i++) {
+			const Packet &packet = recv_packets_[i];
+
+			Message msg;
+			if (!decode_header(packet.data, packet.size, msg)) {
+				continue; // malformed packet, drop it
+			}
+
+			size_t shard = shard_of(msg, packet.address);
+			shards[shard]->dispatch(packet);
+			if (shard != index_) {
+				dispatched_[shard] = true;
+			}
+		}
+
+		received += ret;
+		if ((size_t)ret < count) { // no more data
+			break;
+		}
+	}
+
+	// wake up each other shard once for the whole tick, this shard is
+	// polled by the caller right after
+	for (size_t i = 0; i < count_; i++) {
+		if (dispatched_[i]) {
+			dispatched_[i] = false;
+			shards[i]->wakeup();
+		}
+	}
+
+	return true;
+}
+
+size_t ServerShard::shard_of(const Message &msg, const Endpoint &from)
+{
+	if (count_ == 1) {
+		return 0;
+	}
+
+	if (msg.msg_type == kTypeNewSession) {
+		// no session id yet. with one sock per shard, the kernel keeps
+		// retries from the same address on the same sock, otherwise hash
+		// the address
+		if (sock_per_shard_) {
+			return index_;
+		}
+
+		return from.hash() % count_;
+	}
+
+	return msg.session_id % count_;
+}
+
+void ServerShard::dispatch(const Packet &packet)
+{
+	std::lock_guard<std::mutex> lock(inbox_mutex_);
+	inbox_.push_back(packet);
+}
+
+std::chrono::milliseconds ServerShard::poll()
+{
+	{
+		std::lock_guard<std::mutex> lock(inbox_mutex_);
+		inbox_swap_.swap(inbox_);
 	}
 
-	auto session = internel->connections_.find(address);
+	std::chrono::milliseconds timeout;
+	{
+		std::lock_guard<std::mutex> lock(connections_mutex_);
+		for (const Packet &packet : inbox_swap_) {
+			handle_packet(packet);
+		}
+		inbox_swap_.clear();
+
+		timeout = update_sessions();
+		send_queue_->flush();
+	}
+
+	// callbacks may call the server, e.g. exit stops this shard
+	for (auto &handoff : handoffs_) {
+		handoff.first(handoff.second);
+	}
+	handoffs_.clear();
+
+	for (auto &callback : fired_) {
+		callback();
+	}
+	fired_.clear();
+
+	return timeout;
+}
+
+void ServerShard::handle_packet(const Packet &packet)
+{
+	Message msg;
+	if (!decode_message(packet.data, packet.size, msg)) {
+		return; // malformed packet, drop it
+	}
+
+	handle_message(msg, packet.address);
+}
+
+void ServerShard::handle_message(const Message &msg, const Endpoint &from)
+{
 	if (msg.msg_type == kTypeNewSession) {
+		const Message &offer = msg;
+
 		Message msg;
 		msg.msg_type = kTypeAcceptSession;
 		msg.session_id = 0;
 		msg.msg_size = 0;
 
-		if (session != internel->connections_.end()) {
+		// a retry of handshake gets the same session
+		auto session = connections_.find(from);
+		if (session != connections_.end()) {
 			msg.session_id = session->second->session_id();
+			encode_features(msg, session->second->features());
+			encode_config(msg, session->second->config());
 		} else {
-			auto connection = std::make_shared<ServerConnection>(sock, address);
+			// shed load while the app does not keep up with accept, the
+			// client gives up instead of retrying until handshake timeout
+			if (accept_queue_->full()) {
+				send_queue_->push(kTypeRejectSession, 0, nullptr, 0, from);
+				return;
+			}
+
+			uint32_t features = decode_features(offer) & kUCPSupportedFeatures;
+			Config config = session_config(offer, from);
+			auto connection = std::make_shared<ServerConnection>(
+				send_queue_, ready_queue_, next_session_id(), from, features,
+				config);
 			msg.session_id = connection->session_id();
-			internel->connections_.insert(std::make_pair(address, connection));
-		}
-		sock->send_to(&msg, sizeof(msg), address);
-	} else if (msg.msg_type == kTypeCloseSession) {
-		if (session != internel->connections_.end()) {
-			// remote close but may to recv data
-			session->second->status(kClosed);
+			connections_.insert(std::make_pair(from, connection));
+			sessions_.insert(msg.session_id, connection);
+
+			// the app may use the session once queued
+			std::function<void(std::shared_ptr<ServerConnection>)> waiter;
+			if (!accept_queue_->push(connection, waiter)) {
+				// filled by other shards
+				connections_.erase(from);
+				sessions_.erase(msg.session_id);
+				send_queue_->push(kTypeRejectSession, 0, nullptr, 0, from);
+				return;
+			}
+
+			if (waiter) {
+				handoffs_.push_back(std::make_pair(std::move(waiter),
+												   connection));
+			}
+
+			encode_features(msg, features);
+			encode_config(msg, config);
 		}
+		touched_.push_back(msg.session_id);
+		send_queue_->push(msg, from);
+		return;
+	}
+
+	auto session = sessions_.find(msg.session_id);
+	if (session == nullptr) {
+		return;
+	}
+
+	auto connection = *session;
+	if (connection->endpoint() != from) {
+		handle_path(connection, msg, from);
+		return;
+	}
+
+	if (msg.msg_type == kTypeCloseSession) {
+		// remote close but may to recv data
+		connection->status(kClosed, fired_);
+		touched_.push_back(msg.session_id);
 	} else if (msg.msg_type == kTypeData) {
-		if (session != internel->connections_.end()) {
-			session->second->kcp_intput(msg.msg_data, msg.msg_size);
-			session->second->last_hearbeat_time(
-				std::chrono::steady_clock::now());
-		}
+		connection->kcp_intput(msg.msg_data, msg.msg_size, fired_);
+		connection->last_hearbeat_time(std::chrono::steady_clock::now());
+		touched_.push_back(msg.session_id);
 	} else if (msg.msg_type == kHeartbeat) {
-		if (session != internel->connections_.end()) {
-			session->second->last_hearbeat_time(
-				std::chrono::steady_clock::now());
+		connection->last_hearbeat_time(std::chrono::steady_clock::now());
+
+		Message msg = { kHeartbeat, connection->session_id(), 0 };
+		send_queue_->push(msg, from);
+		touched_.push_back(msg.session_id);
+	}
+	// unknown message, drop it
+}
+
+void ServerShard::handle_path(
+	const std::shared_ptr<ServerConnection> &connection, const Message &msg,
+	const Endpoint &from)
+{
+	// the peer may move to a new address, e.g. nat rebinding. packets of the
+	// new path are dropped until the peer echoes a token sent to it, so a
+	// spoofed address can not take over the session
+	if (msg.msg_type == kTypePathResponse) {
+		if (msg.msg_size != kUCPPathTokenSize) {
+			return;
+		}
 
-			Message msg = { kHeartbeat, session->second->session_id(), 0 };
-			sock->send_to(&msg, sizeof(msg), address);
+		uint64_t token;
+		memcpy(&token, msg.msg_data, sizeof(token));
+		if (!path_validator_->validate(msg.session_id, from, token,
+									   std::chrono::steady_clock::now())) {
+			return;
 		}
-	} else {
-		return kExit;
+
+		Endpoint old_endpoint = connection->endpoint();
+		connection->migrate_path(from);
+
+		auto old = connections_.find(old_endpoint);
+		if (old != connections_.end() && old->second == connection) {
+			connections_.erase(old);
+		}
+		connections_[from] = connection;
+
+		connection->last_hearbeat_time(std::chrono::steady_clock::now());
+		touched_.push_back(msg.session_id);
+		return;
 	}
 
-	return kListen;
+	auto now = std::chrono::steady_clock::now();
+	if (!connection->challenge_path(now)) {
+		return;
+	}
+
+	uint64_t token = path_validator_->token(msg.session_id, from, now);
+	send_queue_->push(kTypePathChallenge, msg.session_id, &token,
+					  sizeof(token), from);
 }
 
-void ServerInternel::exit()
+std::chrono::milliseconds ServerShard::update_sessions()
 {
-	std::lock_guard<std::mutex> lock(status_mutex_);
-	status_ = kExit;
+	ready_queue_->take(touched_);
+
+	uint64_t now = steady_clock_ms();
+	timers_.advance(now, touched_);
+
+	std::sort(touched_.begin(), touched_.end());
+	touched_.erase(std::unique(touched_.begin(), touched_.end()),
+				   touched_.end());
+
+	IUINT32 current = iclock();
+	for (uint32_t session_id : touched_) {
+		auto session = sessions_.find(session_id);
+		if (session == nullptr) {
+			continue;
+		}
+
+		auto connection = *session;
+		if (!connection->kcp_update(fired_)) {
+			timers_.cancel(session_id);
+			connections_.erase(connection->endpoint());
+			sessions_.erase(session_id);
+			continue;
+		}
+
+		auto delay = connection->next_update(current);
+		if (delay == kUCPNoTimeout) {
+			timers_.cancel(session_id);
+		} else {
+			timers_.schedule(session_id, now + delay.count());
+		}
+	}
+	touched_.clear();
+
+	uint64_t next = timers_.next_expiry();
+	if (next == TimerWheel::kNever) {
+		return kUCPNoTimeout;
+	}
+
+	return std::chrono::milliseconds(next > now ? next - now : 0);
+}
+
+uint32_t ServerShard::next_session_id()
+{
+	// ids of this shard are index_ modulo count_, skip 0 and ids in use
+	uint64_t ids = ((uint64_t)UINT32_MAX - index_) / count_ + 1;
+	uint32_t session_id;
+	do {
+		session_id = (uint32_t)(session_id_random_() % ids * count_ + index_);
+	} while (session_id == 0 || sessions_.find(session_id) != nullptr);
+
+	return session_id;
+}
+
+void ServerShard::wakeup()
+{
+	reactor_->wakeup();
+}
+
+void ServerShard::stop()
+{
+	running_ = false;
+	reactor_->wakeup();
+
+	// wake the app blocked in recv or send of sessions
+	std::vector<std::function<void()> > fired;
+	{
+		std::lock_guard<std::mutex> lock(connections_mutex_);
+		sessions_.for_each(
+			[&fired](uint32_t, std::shared_ptr<ServerConnection> &connection) {
+				connection->status(kExit, fired);
+			});
+	}
+
+	for (auto &callback : fired) {
+		callback();
+	}
+}
+
+bool ServerShard::running()
+{
+	return running_;
+}
+
+void ServerShard::config(const Config &config)
+{
+	std::lock_guard<std::mutex> lock(config_mutex_);
+	config_ = config;
+}
+
+void ServerShard::session_config(ConfigSelector selector)
+{
+	std::lock_guard<std::mutex> lock(config_mutex_);
+	config_selector_ = selector;
 }
 
-uint32_t ServerConnection::session_id_counter_ = 0;
+Config ServerShard::session_config(const Message &offer, const Endpoint &from)
+{
+	std::lock_guard<std::mutex> lock(config_mutex_);
+	Config config = config_;
+	Config offered = config_;
+	bool has_offer = decode_config(offer, offered);
+
+	if (config_selector_) {
+		config_selector_(from, offered, config);
+	}
+
+	// an old client offers nothing and runs the defaults
+	return has_offer ? negotiate_config(config, offered) : config;
+}
 
 int ServerConnection::kcp_output(const char *buf, int len, ikcpcb *kcp,
 								 void *user)
+{
+	if (len < 0) {
+		return -1;
+	}
+
+	IKCPVEC vec = { buf, len };
+	return kcp_outputv(&vec, 1, kcp, user);
+}
+
+int ServerConnection::kcp_outputv(const IKCPVEC *vec, int count, ikcpcb *kcp,
+								  void *user)
 {
 	ServerConnection *connection = (ServerConnection *)user;
 
-	Message msg;
-	msg.msg_type = kTypeData;
-	msg.session_id = connection->session_id();
-	msg.msg_size = len;
-	memcpy(msg.msg_data, buf, len);
+	// the header goes into the headroom of kcp, segment data is not copied
+	// until it reaches the send queue
+	struct iovec iov[2];
+	if (count <= 0 || count > 2) {
+		return -1;
+	}
 
-	return connection->sock_->send_to(&msg, sizeof(msg),
-									  connection->remote_address_);
+	size_t size = encode_kcp_packet(connection->session_id_, vec, count, iov);
+	connection->pacer_.send(iov, count, size, [connection](
+		const struct iovec *iov, size_t iovcnt) {
+		connection->send_queue_->push(iov, iovcnt,
+									  connection->remote_endpoint_);
+	});
+	return size - kUCPHeaderSize;
 }
 
-ServerConnection::ServerConnection(std::shared_ptr<Sock> sock,
-								   const std::string &address)
-	: sock_(sock)
-	, remote_address_(address)
+void ServerConnection::release_paced()
+{
+	if (config_.pacing) {
+		uint64_t rate = congestion_ != nullptr ? congestion_->pacing_rate() : 0;
+		pacer_.rate(rate != 0 ? rate : kcp_pacing_rate(kcp_));
+	}
+
+	pacer_.release([this](const struct iovec *iov, size_t iovcnt) {
+		send_queue_->push(iov, iovcnt, remote_endpoint_);
+	});
+}
+
+ServerConnection::ServerConnection(std::shared_ptr<SendQueue> send_queue,
+								   std::shared_ptr<ReadyQueue> ready_queue,
+								   uint32_t session_id,
+								   const Endpoint &endpoint, uint32_t features,
+								   const Config &config)
+	: congestion_(make_congestion_controller(config.congestion))
+	, window_tuner_(config)
+	, send_queue_(send_queue)
+	, ready_queue_(ready_queue)
+	, remote_endpoint_(endpoint)
+	, session_id_(session_id)
+	, features_(features)
+	, config_(config)
 	, status_(kHandshake)
-	, session_id_(++session_id_counter_)
+	, flush_pending_(false)
+	, readers_(0)
+	, writers_(0)
 	, last_hearbeat_time_(std::chrono::steady_clock::now())
 {
-	kcp_ = ikcp_create(session_id_, this);
+	Pool::install();
+
+	kcp_ = ikcp_create_ex(session_id_, this, kcp_create_flags(features_));
 	ikcp_setoutput(kcp_, kcp_output);
-	ikcp_nodelay(kcp_, 1, 10, 2, 1);
-	ikcp_wndsize(kcp_, 128, 128);
-	ikcp_setmtu(kcp_, kUCPMessageSize);
+	ikcp_setoutputv(kcp_, kcp_outputv);
+	ikcp_reserve(kcp_, kUCPHeaderSize);
+	configure_kcp(kcp_, config_);
+	if (congestion_ != nullptr) {
+		congestion_->attach(kcp_);
+	}
 	ikcp_update(kcp_, iclock());
 }
 
@@ -157,39 +768,164 @@ ServerConnection::~ServerConnection()
 ssize_t ServerConnection::send(const void *data, size_t size)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
+	return send_locked(data, size);
+}
+
+ssize_t ServerConnection::send(const void *data, size_t size,
+							   std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(status_mutex_);
+	writers_++;
+	bool ready = wait_until_deadline(writable_, lock, deadline_after(timeout),
+									 [this] { return writable_locked(); });
+	writers_--;
+
+	return ready ? send_locked(data, size) : 0;
+}
+
+ssize_t ServerConnection::send_locked(const void *data, size_t size)
+{
 	if (status_ != kConnected) {
 		return -1;
 	}
-	return ikcp_send(kcp_, (const char *)data, size);
+
+	int ret = ikcp_send(kcp_, (const char *)data, size);
+	if (ret < 0) {
+		return ret;
+	}
+
+	// send it now instead of waiting for next kcp interval
+	flush_pending_ = true;
+	ready_queue_->push(session_id_);
+	return ret;
 }
 
 ssize_t ServerConnection::recv(void *data, size_t size)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
-	if (status_ != kConnected) {
+	return recv_locked(data, size);
+}
+
+ssize_t ServerConnection::recv(void *data, size_t size,
+							   std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(status_mutex_);
+	readers_++;
+	bool ready = wait_until_deadline(readable_, lock, deadline_after(timeout),
+									 [this] { return readable_locked(); });
+	readers_--;
+
+	return ready ? recv_locked(data, size) : 0;
+}
+
+ssize_t ServerConnection::recv_locked(void *data, size_t size)
+{
+	if (status_ != kConnected && status_ != kClosed) {
 		return -1;
 	}
 
 	int ret = ikcp_recv(kcp_, (char *)data, size);
 
 	if (ret < 0) {
-		return 0;
+		// closed session only returns the data already received
+		return status_ == kClosed ? -1 : 0;
+	}
+
+	if (kcp_->probe != 0) { // window reopened, tell remote
+		ready_queue_->push(session_id_);
 	}
 
 	return ret;
 }
 
-int ServerConnection::kcp_intput(const void *data, size_t size)
+ssize_t ServerConnection::recv_view(MessageView &view)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
+	view.release();
 	if (status_ != kConnected && status_ != kClosed) {
 		return -1;
 	}
 
-	return ikcp_input(kcp_, (const char *)data, size);
+	int size = 0;
+	IKCPSEG *segments = ikcp_recv_segments(kcp_, &size);
+	if (segments == nullptr) {
+		return status_ == kClosed ? -1 : 0;
+	}
+
+	if (kcp_->probe != 0) { // window reopened, tell remote
+		ready_queue_->push(session_id_);
+	}
+
+	view = MessageView(segments, size);
+	return size;
 }
 
-bool ServerConnection::kcp_update()
+bool ServerConnection::when_readable(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	if (readable_locked()) {
+		return false;
+	}
+
+	watchers_.readable(std::move(callback));
+	return true;
+}
+
+bool ServerConnection::when_writable(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	if (writable_locked()) {
+		return false;
+	}
+
+	watchers_.writable(std::move(callback));
+	return true;
+}
+
+int ServerConnection::kcp_intput(const void *data, size_t size,
+								 std::vector<std::function<void()> > &fired)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+	if (status_ != kConnected && status_ != kClosed) {
+		return -1;
+	}
+
+	int ret = ikcp_input(kcp_, (const char *)data, size);
+	notify_waiters();
+	watchers_.take(fired);
+	return ret;
+}
+
+bool ServerConnection::readable_locked()
+{
+	return status_ != kConnected || ikcp_peeksize(kcp_) >= 0;
+}
+
+bool ServerConnection::writable_locked()
+{
+	return status_ != kConnected || kcp_writable(kcp_);
+}
+
+void ServerConnection::notify_waiters()
+{
+	if (readers_ == 0 && writers_ == 0 && watchers_.empty()) {
+		return;
+	}
+
+	bool readable = readable_locked();
+	bool writable = writable_locked();
+	if (readers_ > 0 && readable) {
+		readable_.notify_all();
+	}
+
+	if (writers_ > 0 && writable) {
+		writable_.notify_all();
+	}
+
+	watchers_.fire(readable, writable);
+}
+
+bool ServerConnection::kcp_update(std::vector<std::function<void()> > &fired)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
 	if (status_ != kConnected && status_ != kClosed && status_ != kHandshake) {
@@ -197,26 +933,56 @@ bool ServerConnection::kcp_update()
 	}
 
 	if (status_ == kClosed) {
+		release_paced();
 		ikcp_flush(kcp_);
 		Message msg;
 		msg.msg_type = kTypeCloseSession;
 		msg.session_id = session_id_;
 		msg.msg_size = 0;
 
-		sock_->send_to(&msg, sizeof(msg), remote_address_);
+		send_queue_->push(msg, remote_endpoint_);
 	} else if (status_ == kConnected) {
+		release_paced(); // queued packets go before new ones
 		ikcp_update(kcp_, iclock());
+		window_tuner_.update(kcp_);
+		if (flush_pending_) {
+			ikcp_flush(kcp_);
+		}
 	}
 
+	flush_pending_ = false;
+
 	if (std::chrono::steady_clock::now() - last_hearbeat_time_ >
-		kUCPDefaultHeartbeatTimeout) {  // only remove session when timeout
+		config_.heartbeat_timeout) {  // only remove session when timeout
 		status_ = kExit;
+		notify_waiters();
+		watchers_.take(fired);
 		return false;
 	}
 
 	return true;
 }
 
+std::chrono::milliseconds ServerConnection::next_update(IUINT32 current)
+{
+	std::lock_guard<std::mutex> lock(status_mutex_);
+
+	if (status_ == kClosed) { // keep telling remote until timeout
+		return config_.tick();
+	}
+
+	auto timeout =
+		time_until(last_hearbeat_time_ + config_.heartbeat_timeout,
+				   std::chrono::steady_clock::now());
+
+	if (status_ == kConnected) {
+		timeout = std::min(timeout, kcp_next_update(kcp_, current));
+		timeout = std::min(timeout, pacer_.next_release());
+	}
+
+	return timeout;
+}
+
 uint32_t ServerConnection::session_id()
 {
 	return session_id_;
@@ -229,10 +995,13 @@ Status ServerConnection::status()
 	return ret;
 }
 
-bool ServerConnection::status(Status new_status)
+bool ServerConnection::status(Status new_status,
+							  std::vector<std::function<void()> > &fired)
 {
 	std::lock_guard<std::mutex> lock(status_mutex_);
 	status_ = new_status;
+	notify_waiters();
+	watchers_.take(fired);
 	return true;
 }
 
@@ -250,18 +1019,54 @@ bool ServerConnection::accept()
 
 void ServerConnection::close()
 {
-	std::lock_guard<std::mutex> lock(status_mutex_);
+	std::unique_lock<std::mutex> lock(status_mutex_);
 	if (status_ != kConnected) {
 		return;
 	}
 
 	status_ = kClosed;
+	notify_waiters();
+	ready_queue_->push(session_id_);
+	watchers_.run(lock);
 	// do not close socket
 }
 
 std::string ServerConnection::address()
 {
-	return remote_address_;
+	std::lock_guard<std::mutex> lock(endpoint_mutex_);
+	return remote_endpoint_.to_string();
+}
+
+const Endpoint &ServerConnection::endpoint()
+{
+	return remote_endpoint_;
+}
+
+uint32_t ServerConnection::features()
+{
+	return features_;
+}
+
+const Config &ServerConnection::config()
+{
+	return config_;
+}
+
+bool ServerConnection::challenge_path(
+	std::chrono::steady_clock::time_point now)
+{
+	if (now - challenge_time_ < kUCPDefaultPathChallengeInterval) {
+		return false;
+	}
+
+	challenge_time_ = now;
+	return true;
+}
+
+void ServerConnection::migrate_path(const Endpoint &endpoint)
+{
+	std::lock_guard<std::mutex> lock(endpoint_mutex_);
+	remote_endpoint_ = endpoint;
 }
 
 std::chrono::steady_clock::time_point ServerConnection::last_hearbeat_time()
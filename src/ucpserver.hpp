@@ -1,111 +1,418 @@
 #ifndef UCP_SRC_UCPSERVER_HPP_
 #define UCP_SRC_UCPSERVER_HPP_
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <queue>
+#include <random>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include <mutex>
 #include <iostream>
 
 #include "ucpbase.hpp"
+#include "ucpcongestion.hpp"
+#include "ucpconfig.hpp"
+#include "ucpflatmap.hpp"
+#include "ucphandler.hpp"
+#include "ucppacer.hpp"
+#include "ucppath.hpp"
+#include "ucpreactor.hpp"
+#include "ucptimer.hpp"
+#include "ucpwindow.hpp"
 #include "kcp/ikcp.h"
 
 namespace ucp {
 
 class ServerConnection : public Session {
 private:
-	static uint32_t session_id_counter_;
-
 	static int kcp_output(const char *buf, int len, ikcpcb *kcp, void *user);
+	static int kcp_outputv(const IKCPVEC *vec, int count, ikcpcb *kcp,
+						   void *user);
 
 public:
 	ServerConnection() = delete;
-	ServerConnection(std::shared_ptr<Sock> sock, const std::string &address);
+	ServerConnection(std::shared_ptr<SendQueue> send_queue,
+					 std::shared_ptr<ReadyQueue> ready_queue,
+					 uint32_t session_id, const Endpoint &endpoint,
+					 uint32_t features, const Config &config);
 
 	~ServerConnection() override;
 
 	ssize_t send(const void *data, size_t size) override;
+	ssize_t send(const void *data, size_t size,
+				 std::chrono::milliseconds timeout) override;
 
 	ssize_t recv(void *data, size_t size) override;
+	ssize_t recv(void *data, size_t size,
+				 std::chrono::milliseconds timeout) override;
+	ssize_t recv_view(MessageView &view) override;
+	bool when_readable(std::function<void()> callback) override;
+	bool when_writable(std::function<void()> callback) override;
 	void close() override;
 
 	std::string address() override;
 
-	int kcp_intput(const void *data, size_t size);
+	// only called by the shard thread
+	const Endpoint &endpoint();
+
+	// features negotiated in handshake
+	uint32_t features();
+
+	// config negotiated in handshake
+	const Config &config();
+
+	/**
+	 * @brief take the slot of a path challenge, any path of the session
+	 * shares it, so spoofed addresses can not multiply challenges
+	 * 
+	 * @param now 
+	 * @return true if a path challenge may be sent
+	 * @return false if challenged recently
+	 */
+	bool challenge_path(std::chrono::steady_clock::time_point now);
+
+	/**
+	 * @brief switch to a new path whose token is validated
+	 * 
+	 * @param endpoint new endpoint of the peer
+	 */
+	void migrate_path(const Endpoint &endpoint);
+
+	// the calls of the shard below add fired watchers to fired, which the
+	// shard runs once it unlocked its sessions
+	int kcp_intput(const void *data, size_t size,
+				   std::vector<std::function<void()> > &fired);
 
 	// return false if need to remove from connections
-	bool kcp_update();
+	bool kcp_update(std::vector<std::function<void()> > &fired);
+
+	// time until next kcp_update is needed
+	std::chrono::milliseconds next_update(IUINT32 current);
 
 	uint32_t session_id();
 	Status status();
-	bool status(Status new_status);
+	bool status(Status new_status,
+				std::vector<std::function<void()> > &fired);
 
+	// handshake is done, the app accepted the session
 	bool accept();
 
 	bool last_hearbeat_time(std::chrono::steady_clock::time_point time);
 	std::chrono::steady_clock::time_point last_hearbeat_time();
 
 private:
+	// send data packets the pacer allows, called with status_mutex_ held
+	void release_paced();
+
+	// called with status_mutex_ held
+	ssize_t send_locked(const void *data, size_t size);
+	ssize_t recv_locked(void *data, size_t size);
+
+	// wake blocked send and recv which can go on and fire watchers, called
+	// with status_mutex_ held after input or a status change
+	void notify_waiters();
+
+	bool readable_locked();
+	bool writable_locked();
+
 	ikcpcb *kcp_;
-	std::shared_ptr<Sock> sock_;
-	std::string remote_address_;
+	std::unique_ptr<CongestionController> congestion_;
+	Pacer pacer_;
+	WindowTuner window_tuner_;
+	std::shared_ptr<SendQueue> send_queue_;
+	std::shared_ptr<ReadyQueue> ready_queue_;
+	std::mutex endpoint_mutex_;
+	Endpoint remote_endpoint_;
 	uint32_t session_id_;
+	uint32_t features_;
+	Config config_;
+
+	// last path challenge sent
+	std::chrono::steady_clock::time_point challenge_time_;
 
 	std::mutex status_mutex_;
 	Status status_;
+	bool flush_pending_;
+
+	// blocked recv and send
+	std::condition_variable readable_;
+	std::condition_variable writable_;
+	size_t readers_;
+	size_t writers_;
+	SessionWatchers watchers_;
 
 	std::chrono::steady_clock::time_point last_hearbeat_time_;
 };
 
-class ServerInternel {
+/**
+ * @brief sessions created by the shards and not accepted yet, bounded by the
+ * backlog
+ * 
+ */
+class AcceptQueue {
+public:
+	AcceptQueue() = delete;
+	explicit AcceptQueue(size_t backlog);
+
+	// max sessions waiting, sessions already queued stay
+	void backlog(size_t backlog);
+
+	bool full();
+
+	/**
+	 * @brief queue a new session, called by the shard threads
+	 * 
+	 * @param connection 
+	 * @param waiter set to a callback of pop taking the session instead of
+	 * queuing it, the caller runs it once it holds no lock, as it may call
+	 * the server
+	 * @return true 
+	 * @return false if the backlog is full or closed
+	 */
+	bool push(std::shared_ptr<ServerConnection> connection,
+			  std::function<void(std::shared_ptr<ServerConnection>)> &waiter);
+
+	/**
+	 * @brief take the oldest session, waiting until one is queued
+	 * 
+	 * @param deadline from deadline_after
+	 * @return std::shared_ptr<ServerConnection> nullptr if deadline passed or
+	 * closed
+	 */
+	std::shared_ptr<ServerConnection>
+	pop(std::chrono::steady_clock::time_point deadline);
+
+	/**
+	 * @brief take the oldest session without waiting
+	 * 
+	 * @param callback called once with the session, at once if one is
+	 * queued, otherwise by the shard thread queuing the next one after it
+	 * unlocked the shard, nullptr if closed
+	 */
+	void pop(std::function<void(std::shared_ptr<ServerConnection>)> callback);
+
+	// drop queued sessions and wake waiters for good, the server is exiting
+	void close();
+
+private:
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<std::shared_ptr<ServerConnection> > queue_;
+	// callbacks of pop, served before queuing
+	std::deque<std::function<void(std::shared_ptr<ServerConnection>)> >
+		waiters_;
+	size_t backlog_;
+	bool closed_;
+};
+
+/**
+ * @brief a partition of sessions, owns the sessions whose
+ * session_id % count == index, with its own timers and output path
+ * 
+ */
+class ServerShard {
+public:
+	ServerShard() = delete;
+	ServerShard(size_t index, size_t count, std::shared_ptr<Sock> sock,
+				bool sock_per_shard,
+				std::shared_ptr<AcceptQueue> accept_queue,
+				std::shared_ptr<const PathValidator> path_validator);
+	~ServerShard() = default;
+
+	/**
+	 * @brief read packets from sock until it is empty or budget is exhausted,
+	 * and dispatch them to the shards owning them
+	 * 
+	 * @param shards all shards of the server
+	 * @param budget max packets to read, 0 for no limit
+	 * @return true 
+	 * @return false if socket error
+	 */
+	bool ingest(const std::vector<std::shared_ptr<ServerShard> > &shards,
+				size_t budget);
+
+	/**
+	 * @brief queue a packet for this shard, called by the ingest thread
+	 * 
+	 * @param packet 
+	 */
+	void dispatch(const Packet &packet);
+
+	/**
+	 * @brief handle queued packets, update sessions and flush output
+	 * 
+	 * @return std::chrono::milliseconds time until next poll is needed
+	 */
+	std::chrono::milliseconds poll();
+
+	void wakeup();
+	void stop();
+	bool running();
+
+	// config of new sessions
+	void config(const Config &config);
+	void session_config(ConfigSelector selector);
+
+	std::shared_ptr<Sock> sock_;
+	std::shared_ptr<Reactor> reactor_;
+
+private:
+	void handle_packet(const Packet &packet);
+	void handle_message(const Message &msg, const Endpoint &from);
+	void handle_path(const std::shared_ptr<ServerConnection> &connection,
+					 const Message &msg, const Endpoint &from);
+	std::chrono::milliseconds update_sessions();
+	uint32_t next_session_id();
+
+	// config of a new session from the offer in handshake
+	Config session_config(const Message &offer, const Endpoint &from);
+
+	// shard which owns the session of message
+	size_t shard_of(const Message &msg, const Endpoint &from);
+
+	size_t index_;
+	size_t count_;
+	bool sock_per_shard_;
+	// session ids are drawn at random, so a sender off the path can not
+	// guess the id of a session to spray it
+	std::random_device session_id_random_;
+	std::atomic<bool> running_;
+
+	std::mutex config_mutex_;
+	Config config_;
+	ConfigSelector config_selector_;
+	std::shared_ptr<const PathValidator> path_validator_;
+
+	std::mutex connections_mutex_;
+	// by address, only to find the session of a handshake retry
+	std::unordered_map<Endpoint, std::shared_ptr<ServerConnection> >
+		connections_;
+	// packets are demultiplexed by session id
+	FlatMap<std::shared_ptr<ServerConnection> > sessions_;
+
+	std::shared_ptr<SendQueue> send_queue_;
+	std::shared_ptr<ReadyQueue> ready_queue_;
+	std::shared_ptr<AcceptQueue> accept_queue_;
+	// new sessions taken by callbacks of AcceptQueue::pop and fired watchers
+	// of sessions, run after connections_mutex_ is released as they may
+	// call the server
+	std::vector<std::pair<
+		std::function<void(std::shared_ptr<ServerConnection>)>,
+		std::shared_ptr<ServerConnection> > >
+		handoffs_;
+	std::vector<std::function<void()> > fired_;
+
+	// only sessions touched or expired are updated in a poll
+	TimerWheel timers_;
+	std::vector<uint32_t> touched_;
+
+	// packets dispatched by the ingest thread
+	std::mutex inbox_mutex_;
+	std::vector<Packet> inbox_;
+	std::vector<Packet> inbox_swap_;
+
+	// used by ingest
+	std::vector<Packet> recv_packets_;
+	std::vector<bool> dispatched_;
+};
+
+class ServerInternel : public std::enable_shared_from_this<ServerInternel> {
 public:
 	static void monitor_thread_func(std::shared_ptr<Sock> sock,
 									std::shared_ptr<ServerInternel> internel);
+	static void worker_thread_func(std::shared_ptr<ServerInternel> internel,
+								   size_t index);
 	static Status
 	tranfer_status_from_init(std::shared_ptr<Sock> sock,
 							 std::shared_ptr<ServerInternel> internel);
 	static Status
-	tranfer_status_from_listen(std::shared_ptr<Sock> sock,
-							   std::shared_ptr<ServerInternel> internel);
+	tranfer_status_from_listen(std::shared_ptr<ServerInternel> internel);
 
-	ServerInternel() = default;
+	ServerInternel() = delete;
+	ServerInternel(const std::vector<std::shared_ptr<Sock> > &socks,
+				   size_t workers);
 	~ServerInternel() = default;
 
 	bool status(Status new_status);
 
+	/**
+	 * @brief see Server::async_accept
+	 * 
+	 */
+	void async_accept(std::function<void(std::shared_ptr<Session>)> callback);
+
+	/**
+	 * @brief see Server::handlers
+	 * 
+	 */
+	bool handlers(std::shared_ptr<const Handlers> handlers,
+				  Dispatcher dispatcher);
+
 	void exit();
 
 	std::mutex status_mutex_;
 	Status status_;
-
-	std::mutex connections_mutex_;
-	std::unordered_map<std::string, std::shared_ptr<ServerConnection> >
-		connections_;
+	std::atomic<size_t> ingest_budget_;
+
+	// shards_[0] is served by the monitor thread, others by worker threads.
+	// with one sock per shard, every shard reads its own sock, otherwise
+	// shards_[0] reads the only sock for all
+	std::vector<std::shared_ptr<ServerShard> > shards_;
+	bool sock_per_shard_;
+
+	// new sessions of all shards
+	std::shared_ptr<AcceptQueue> accept_queue_;
+	// secret of path tokens, a session is always served by the same shard
+	// but the secret is per server
+	std::shared_ptr<const PathValidator> path_validator_;
 };
 
-
 template <class T>
 class Server {
 public:
-	Server<T>()
-		: internel_(std::make_shared<ServerInternel>())
-		, sock_(std::make_shared<T>())
+	/**
+	 * @brief construct a new server
+	 * 
+	 * @param workers number of threads serving sessions, sessions are sharded
+	 * by session id across them
+	 * @param reuse_port open one sock per worker bound to the same address,
+	 * falls back to one shared sock if T does not support Sock::reuse_port
+	 */
+	explicit Server(size_t workers = 1, bool reuse_port = false)
+		: socks_(create_socks(workers, reuse_port))
+		, steered_(false)
+		, internel_(std::make_shared<ServerInternel>(socks_, workers))
 	{
-		monitor_thread_ =
-			std::thread(ServerInternel::monitor_thread_func, sock_, internel_);
+		monitor_thread_ = std::thread(ServerInternel::monitor_thread_func,
+									  socks_[0], internel_);
+
+		for (size_t i = 1; i < internel_->shards_.size(); i++) {
+			worker_threads_.emplace_back(ServerInternel::worker_thread_func,
+										 internel_, i);
+		}
 	}
 
-	~Server<T>()
+	~Server()
 	{
 		internel_->exit();
 		monitor_thread_.join();
-		sock_->close();
+		for (auto &worker : worker_threads_) {
+			worker.join();
+		}
+		for (auto &sock : socks_) {
+			sock->close();
+		}
 	}
 
 	/**
@@ -115,7 +422,7 @@ public:
 	 */
 	std::string address()
 	{
-		return sock_->address();
+		return socks_[0]->address();
 	}
 
 	/**
@@ -133,17 +440,131 @@ public:
 		}
 
 		internel_->status_ = kListen;
+		for (auto &shard : internel_->shards_) {
+			shard->wakeup();
+		}
+
+		// socks join the reuseport group in bind order
+		for (auto &sock : socks_) {
+			if (!sock->bind(address)) {
+				return false;
+			}
+		}
+
+		// packets on a wrong sock are handed to the owning shard, so a
+		// failure costs a thread handoff per packet, see steered
+		if (socks_.size() > 1) {
+			steered_ = socks_[0]->steer_by_session(socks_.size());
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief check if the kernel delivers each session to the sock of the
+	 * thread owning it, set by listen_at
+	 * 
+	 * @return true 
+	 * @return false with one sock, or if Sock::steer_by_session failed and
+	 * packets are handed between threads
+	 */
+	bool steered()
+	{
+		return steered_;
+	}
+
+	/**
+	 * @brief set max packets read from socket in one tick
+	 * 
+	 * @param budget 0 for no limit
+	 */
+	void ingest_budget(size_t budget)
+	{
+		internel_->ingest_budget_ = budget;
+	}
+
+	/**
+	 * @brief set max sessions waiting for accept, a client connecting while
+	 * the backlog is full is rejected
+	 * 
+	 * @param backlog kUCPDefaultAcceptBacklog by default
+	 */
+	void backlog(size_t backlog)
+	{
+		internel_->accept_queue_->backlog(backlog);
+	}
+
+	/**
+	 * @brief set config of sessions accepted after the call, it is
+	 * negotiated with the config offered by each client
+	 * 
+	 * @param config 
+	 */
+	void config(const Config &config)
+	{
+		config_ = config;
+		for (auto &shard : internel_->shards_) {
+			shard->config(config_);
+		}
+	}
+
+	/**
+	 * @brief override config per session, e.g. follow the profile of the
+	 * client, before it is negotiated
+	 * 
+	 * @param selector 
+	 */
+	void session_config(ConfigSelector selector)
+	{
+		for (auto &shard : internel_->shards_) {
+			shard->session_config(selector);
+		}
+	}
 
-		return sock_->bind(address);
+	/**
+	 * @brief set congestion control of sessions accepted after the call,
+	 * kCongestionNone by default
+	 * 
+	 * @param type 
+	 */
+	void congestion_control(CongestionControl type)
+	{
+		config_.congestion = type;
+		config(config_);
 	}
 
 	/**
-	 * @brief accept a new connection
+	 * @brief pace output of sessions accepted after the call at a rate from
+	 * cwnd and srtt, or the rate of the congestion controller, enabled by
+	 * default
 	 * 
-	 * @return std::shared_ptr<Session> 
+	 * @param enable 
+	 */
+	void pacing(bool enable)
+	{
+		config_.pacing = enable;
+		config(config_);
+	}
+
+	/**
+	 * @brief accept a new connection, waiting until a client connects
+	 * 
+	 * @return std::shared_ptr<Session> nullptr if not listening
 	 */
 	std::shared_ptr<Session> accept()
 	{
+		return accept(kUCPNoTimeout);
+	}
+
+	/**
+	 * @brief accept a new connection, waiting at most timeout
+	 * 
+	 * @param timeout kUCPNoTimeout to wait without timeout
+	 * @return std::shared_ptr<Session> nullptr if timed out or not listening
+	 */
+	std::shared_ptr<Session> accept(std::chrono::milliseconds timeout)
+	{
+		auto deadline = deadline_after(timeout);
 		while (true) {
 			{
 				std::lock_guard<std::mutex> lock(internel_->status_mutex_);
@@ -152,28 +573,80 @@ public:
 				}
 			}
 
-			{
-				std::lock_guard<std::mutex> lock(internel_->connections_mutex_);
-				for (auto &iter : internel_->connections_) {
-					if (iter.second->accept()) {
-						return iter.second;
-					}
-				}
+			auto connection = internel_->accept_queue_->pop(deadline);
+			if (connection == nullptr) {
+				return nullptr;
 			}
 
-			std::this_thread::sleep_for(kUCPDefaultInterval);
+			// a session may time out while queued
+			if (connection->accept()) {
+				return connection;
+			}
 		}
 	}
 
+	/**
+	 * @brief accept a new connection without waiting
+	 * 
+	 * @param callback called once with the session, at once if a client is
+	 * waiting, otherwise by a network thread when one connects, nullptr if
+	 * the server exits
+	 */
+	void async_accept(std::function<void(std::shared_ptr<Session>)> callback)
+	{
+		internel_->async_accept(std::move(callback));
+	}
+
+	/**
+	 * @brief push new sessions and their events to handlers, accept does not
+	 * return sessions any more
+	 * 
+	 * @param handlers 
+	 * @param dispatcher runs handlers, nullptr to run them in the network
+	 * threads, which must not be blocked by them
+	 * @return true 
+	 * @return false if not listening
+	 */
+	bool handlers(const Handlers &handlers, Dispatcher dispatcher = nullptr)
+	{
+		return internel_->handlers(std::make_shared<const Handlers>(handlers),
+								   std::move(dispatcher));
+	}
+
 	void exit()
 	{
 		internel_->exit();
 	}
 
 private:
-	std::shared_ptr<Sock> sock_;
+	static std::vector<std::shared_ptr<Sock> > create_socks(size_t workers,
+														   bool reuse_port)
+	{
+		std::vector<std::shared_ptr<Sock> > socks;
+		socks.push_back(std::make_shared<T>());
+
+		if (!reuse_port || workers <= 1 || !socks[0]->reuse_port()) {
+			return socks;
+		}
+
+		for (size_t i = 1; i < workers; i++) {
+			auto sock = std::make_shared<T>();
+			if (!sock->reuse_port()) {
+				socks.resize(1);
+				break;
+			}
+			socks.push_back(sock);
+		}
+
+		return socks;
+	}
+
+	std::vector<std::shared_ptr<Sock> > socks_;
+	bool steered_;
 	std::thread monitor_thread_;
+	std::vector<std::thread> worker_threads_;
 	std::shared_ptr<ServerInternel> internel_;
+	Config config_;
 };
 
 } // namespace ucp
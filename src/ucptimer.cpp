@@ -0,0 +1,135 @@
+#include "ucptimer.hpp"
+
+#include <utility>
+
+using namespace ucp;
+
+TimerWheel::TimerWheel(uint64_t now)
+	: current_(now)
+{
+}
+
+void TimerWheel::schedule(uint32_t id, uint64_t deadline)
+{
+	auto it = deadlines_.find(id);
+	if (it != deadlines_.end()) {
+		if (it->second == deadline) {
+			return;
+		}
+
+		// the old entry is dropped lazily when its slot is reached
+		it->second = deadline;
+	} else {
+		deadlines_.emplace(id, deadline);
+	}
+
+	insert({ id, deadline });
+}
+
+void TimerWheel::cancel(uint32_t id)
+{
+	deadlines_.erase(id);
+}
+
+void TimerWheel::insert(const Entry &entry)
+{
+	if (entry.deadline <= current_) {
+		due_.push_back(entry);
+		return;
+	}
+
+	uint64_t delta = entry.deadline - current_;
+	for (int level = 0; level < kLevels; level++) {
+		uint64_t span = (uint64_t)1 << (kSlotBits * (level + 1));
+		if (delta < span || level == kLevels - 1) {
+			// too far away, park it in the last slot of the top level
+			uint64_t position = delta < span ? entry.deadline
+											 : current_ + span - 1;
+			uint64_t slot = (position >> (kSlotBits * level)) & kSlotMask;
+			slots_[level][slot].push_back(entry);
+			return;
+		}
+	}
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<uint32_t> &expired)
+{
+	auto collect = [&](std::vector<Entry> &entries) {
+		for (const Entry &entry : entries) {
+			auto it = deadlines_.find(entry.id);
+			if (it != deadlines_.end() && it->second == entry.deadline) {
+				expired.push_back(entry.id);
+				deadlines_.erase(it);
+			}
+		}
+		entries.clear();
+	};
+
+	collect(due_);
+
+	if (deadlines_.empty()) { // nothing pending, skip the idle time
+		for (int level = 0; level < kLevels; level++) {
+			for (uint64_t slot = 0; slot < kSlots; slot++) {
+				slots_[level][slot].clear();
+			}
+		}
+		current_ = now > current_ ? now : current_;
+		return;
+	}
+
+	while (current_ < now) {
+		current_++;
+
+		// cascade from top level, so entries reach the lower levels in time
+		for (int level = kLevels - 1; level > 0; level--) {
+			uint64_t mask = ((uint64_t)1 << (kSlotBits * level)) - 1;
+			if ((current_ & mask) != 0) {
+				continue;
+			}
+
+			uint64_t slot = (current_ >> (kSlotBits * level)) & kSlotMask;
+			std::vector<Entry> entries;
+			entries.swap(slots_[level][slot]);
+			for (const Entry &entry : entries) {
+				auto it = deadlines_.find(entry.id);
+				if (it != deadlines_.end() && it->second == entry.deadline) {
+					insert(entry);
+				}
+			}
+		}
+
+		collect(due_);
+		collect(slots_[0][current_ & kSlotMask]);
+	}
+}
+
+uint64_t TimerWheel::next_expiry() const
+{
+	if (deadlines_.empty()) {
+		return kNever;
+	}
+
+	if (!due_.empty()) {
+		return current_;
+	}
+
+	uint64_t next = kNever;
+	for (int level = 0; level < kLevels; level++) {
+		int shift = kSlotBits * level;
+		for (uint64_t i = 1; i <= kSlots; i++) {
+			// the first tick of the slot, when it is collected or cascaded
+			uint64_t tick = ((current_ >> shift) + i) << shift;
+			if (!slots_[level][(tick >> shift) & kSlotMask].empty()) {
+				next = tick < next ? tick : next;
+				break;
+			}
+		}
+	}
+
+	return next;
+}
+
+size_t TimerWheel::size() const
+{
+	return deadlines_.size();
+}
@@ -0,0 +1,81 @@
+#ifndef UCP_SRC_UCPTIMER_HPP_
+#define UCP_SRC_UCPTIMER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace ucp {
+
+/**
+ * @brief hierarchical timing wheel with 1ms resolution, each id has at most
+ * one pending timer
+ * 
+ */
+class TimerWheel {
+public:
+	static constexpr uint64_t kNever = UINT64_MAX;
+
+	/**
+	 * @brief construct a new timer wheel
+	 * 
+	 * @param now current time in milliseconds
+	 */
+	TimerWheel(uint64_t now);
+
+	/**
+	 * @brief schedule timer of id, replace the pending one
+	 * 
+	 * @param id 
+	 * @param deadline time in milliseconds
+	 */
+	void schedule(uint32_t id, uint64_t deadline);
+
+	/**
+	 * @brief cancel timer of id
+	 * 
+	 * @param id 
+	 */
+	void cancel(uint32_t id);
+
+	/**
+	 * @brief advance to now and collect expired timers
+	 * 
+	 * @param now current time in milliseconds
+	 * @param expired ids of expired timers are appended to it
+	 */
+	void advance(uint64_t now, std::vector<uint32_t> &expired);
+
+	/**
+	 * @brief get time to call advance next, may be earlier than the nearest
+	 * deadline
+	 * 
+	 * @return uint64_t kNever if no timer
+	 */
+	uint64_t next_expiry() const;
+
+	size_t size() const;
+
+private:
+	static constexpr int kLevels = 4;
+	static constexpr int kSlotBits = 6;
+	static constexpr uint64_t kSlots = 1 << kSlotBits;
+	static constexpr uint64_t kSlotMask = kSlots - 1;
+
+	struct Entry {
+		uint32_t id;
+		uint64_t deadline;
+	};
+
+	void insert(const Entry &entry);
+
+	uint64_t current_;
+	std::vector<Entry> slots_[kLevels][kSlots];
+	std::vector<Entry> due_;
+	std::unordered_map<uint32_t, uint64_t> deadlines_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPTIMER_HPP_
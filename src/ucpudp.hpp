@@ -10,41 +10,17 @@
 
 #include "ucpbase.hpp"
 #include <arpa/inet.h>
+#include <linux/filter.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
 #include <fcntl.h>
 #include <shared_mutex>
 
 namespace ucp {
 class UDPSock : public Sock {
-public:
-	static bool str_to_sockaddr(const std::string &address,
-								struct sockaddr_in &addr)
-	{
-		// address is ip:port
-		auto pos = address.find(':');
-		if (pos == std::string::npos) {
-			return false;
-		}
-
-		addr.sin_family = AF_INET;
-		addr.sin_port = htons(std::stoi(address.substr(pos + 1)));
-		addr.sin_addr.s_addr = inet_addr(address.substr(0, pos).c_str());
-		return true;
-	}
-
-	static bool sockaddr_to_str(const struct sockaddr_in &addr,
-								std::string &address)
-	{
-		char buf[32];
-		if (inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf)) == nullptr) {
-			return false;
-		}
-
-		address = std::string(buf) + ":" + std::to_string(ntohs(addr.sin_port));
-		return true;
-	}
-
 public:
 	UDPSock()
 	{
@@ -77,12 +53,13 @@ public:
 			return true;
 		}
 
-		struct sockaddr_in addr;
-		if (!str_to_sockaddr(address, addr)) {
+		Endpoint endpoint;
+		if (!endpoint.parse(address) ||
+			endpoint.addr.sa.sa_family != AF_INET) {
 			return false;
 		}
 
-		if (::bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		if (::bind(fd_, &endpoint.addr.sa, endpoint.len) == -1) {
 			return false;
 		}
 
@@ -93,44 +70,54 @@ public:
 	{
 		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
 
-		struct sockaddr_in addr;
-		socklen_t addr_len = sizeof(addr);
-		if (getsockname(fd_, (struct sockaddr *)&addr, &addr_len) == -1) {
+		Endpoint endpoint;
+		endpoint.len = sizeof(endpoint.addr);
+		if (getsockname(fd_, &endpoint.addr.sa, &endpoint.len) == -1) {
 			return "";
 		}
 
-		std::string address;
-		return sockaddr_to_str(addr, address) ? address : "";
+		return endpoint.to_string();
 	}
 
 	ssize_t send_to(const void *data, size_t size,
-					const std::string &address) override
+					const Endpoint &to) override
 	{
 		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
-		if (fd_ == -1) {
+		if (fd_ == -1 || to.empty()) {
 			return -1;
 		}
 
-		struct sockaddr_in addr;
-		if (!str_to_sockaddr(address, addr)) {
+		return sendto(fd_, data, size, 0, &to.addr.sa, to.len);
+	}
+
+	ssize_t send_to(const struct iovec *iov, size_t iovcnt,
+					const Endpoint &to) override
+	{
+		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
+		if (fd_ == -1 || to.empty()) {
 			return -1;
 		}
 
-		return sendto(fd_, data, size, 0, (struct sockaddr *)&addr,
-					  sizeof(addr));
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = (void *)&to.addr;
+		msg.msg_namelen = to.len;
+		msg.msg_iov = (struct iovec *)iov;
+		msg.msg_iovlen = iovcnt;
+		return sendmsg(fd_, &msg, 0);
 	}
 
-	ssize_t recv_from(void *data, size_t size, std::string &address) override
+	ssize_t recv_from(void *data, size_t size, Endpoint &from) override
 	{
 		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
 		if (fd_ == -1) {
 			return -1;
 		}
 
-		struct sockaddr_in addr;
-		socklen_t addr_len = sizeof(addr);
-		ssize_t ret =
-			recvfrom(fd_, data, size, 0, (struct sockaddr *)&addr, &addr_len);
+		Endpoint endpoint;
+		endpoint.len = sizeof(endpoint.addr);
+		ssize_t ret = recvfrom(fd_, data, size, 0, &endpoint.addr.sa,
+							   &endpoint.len);
 
 		if (ret < 0) {
 			if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -139,12 +126,140 @@ public:
 		}
 
 		if (ret > 0) {
-			sockaddr_to_str(addr, address);
+			from = endpoint;
 		}
 
 		return ret;
 	}
 
+	ssize_t send_batch(const Packet *packets, size_t count) override
+	{
+		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
+		if (fd_ == -1) {
+			return -1;
+		}
+
+		struct mmsghdr msgs[kUCPBatchSize];
+		struct iovec iovs[kUCPBatchSize];
+
+		size_t n = 0;
+		for (; n < count && n < kUCPBatchSize; n++) {
+			// stop at an empty endpoint, it fails on the next call
+			if (packets[n].address.empty()) {
+				break;
+			}
+
+			iovs[n].iov_base = (void *)packets[n].data;
+			iovs[n].iov_len = packets[n].size;
+
+			memset(&msgs[n], 0, sizeof(msgs[n]));
+			msgs[n].msg_hdr.msg_name = (void *)&packets[n].address.addr;
+			msgs[n].msg_hdr.msg_namelen = packets[n].address.len;
+			msgs[n].msg_hdr.msg_iov = &iovs[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+		}
+
+		if (n == 0) {
+			return -1;
+		}
+
+		return sendmmsg(fd_, msgs, n, 0);
+	}
+
+	ssize_t recv_batch(Packet *packets, size_t count) override
+	{
+		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
+		if (fd_ == -1) {
+			return -1;
+		}
+
+		struct mmsghdr msgs[kUCPBatchSize];
+		struct iovec iovs[kUCPBatchSize];
+
+		size_t n = count < kUCPBatchSize ? count : kUCPBatchSize;
+		for (size_t i = 0; i < n; i++) {
+			iovs[i].iov_base = packets[i].data;
+			iovs[i].iov_len = sizeof(packets[i].data);
+
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			// the kernel writes the source address into the packet directly
+			msgs[i].msg_hdr.msg_name = &packets[i].address.addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(packets[i].address.addr);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int ret = recvmmsg(fd_, msgs, n, MSG_DONTWAIT, nullptr);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 0;
+			}
+			return -1;
+		}
+
+		for (int i = 0; i < ret; i++) {
+			packets[i].size = msgs[i].msg_len;
+			packets[i].address.len = msgs[i].msg_hdr.msg_namelen;
+		}
+
+		return ret;
+	}
+
+	bool reuse_port() override
+	{
+		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
+
+		int enable = 1;
+		return setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &enable,
+						  sizeof(enable)) == 0;
+	}
+
+	bool steer_by_session(size_t count) override
+	{
+		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
+
+		// the program runs on the udp payload and returns the index of the
+		// sock in the reuseport group
+		struct sock_filter code[] = {
+			// A = session id, little-endian at offset 1
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 4),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 3),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 2),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 4),
+			// no session yet, A = source ip ^ source port, so handshake
+			// retries reach the same sock (assume no ip options)
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)SKF_NET_OFF + 12),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, (uint32_t)SKF_NET_OFF + 20),
+			BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)count),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		};
+
+		struct sock_fprog prog;
+		prog.len = sizeof(code) / sizeof(code[0]);
+		prog.filter = code;
+
+		return setsockopt(fd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+						  sizeof(prog)) == 0;
+	}
+
+	int fd() override
+	{
+		std::shared_lock<std::shared_mutex> lock(fd_mutex_);
+		return fd_;
+	}
+
 	void close() override
 	{
 		std::unique_lock<std::shared_mutex> lock(fd_mutex_);
@@ -0,0 +1,138 @@
+#include "ucpview.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace ucp;
+
+namespace {
+
+inline const IKCPSEG *next_segment(const IKCPSEG *seg)
+{
+	return seg->node.next != nullptr
+			   ? iqueue_entry(seg->node.next, IKCPSEG, node)
+			   : nullptr;
+}
+
+} // namespace
+
+MessageView::Iterator::Iterator(const IKCPSEG *seg)
+	: seg_(seg)
+{
+}
+
+MessageView::Piece MessageView::Iterator::operator*() const
+{
+	return Piece{ seg_->data, seg_->len };
+}
+
+MessageView::Iterator &MessageView::Iterator::operator++()
+{
+	seg_ = next_segment(seg_);
+	return *this;
+}
+
+bool MessageView::Iterator::operator==(const Iterator &other) const
+{
+	return seg_ == other.seg_;
+}
+
+bool MessageView::Iterator::operator!=(const Iterator &other) const
+{
+	return seg_ != other.seg_;
+}
+
+MessageView::MessageView()
+	: segments_(nullptr)
+	, size_(0)
+{
+}
+
+MessageView::MessageView(IKCPSEG *segments, size_t size)
+	: segments_(segments)
+	, size_(size)
+{
+}
+
+MessageView::~MessageView()
+{
+	release();
+}
+
+MessageView::MessageView(MessageView &&other)
+	: segments_(other.segments_)
+	, size_(other.size_)
+{
+	other.segments_ = nullptr;
+	other.size_ = 0;
+}
+
+MessageView &MessageView::operator=(MessageView &&other)
+{
+	if (this != &other) {
+		release();
+		std::swap(segments_, other.segments_);
+		std::swap(size_, other.size_);
+	}
+
+	return *this;
+}
+
+void MessageView::release()
+{
+	if (segments_ != nullptr) {
+		ikcp_recv_release(segments_);
+		segments_ = nullptr;
+	}
+
+	size_ = 0;
+}
+
+size_t MessageView::size() const
+{
+	return size_;
+}
+
+bool MessageView::empty() const
+{
+	return segments_ == nullptr;
+}
+
+MessageView::Iterator MessageView::begin() const
+{
+	return Iterator(segments_);
+}
+
+MessageView::Iterator MessageView::end() const
+{
+	return Iterator(nullptr);
+}
+
+size_t MessageView::to_iovec(struct iovec *iov, size_t count) const
+{
+	size_t n = 0;
+	for (Piece piece : *this) {
+		if (n < count) {
+			iov[n].iov_base = (void *)piece.data;
+			iov[n].iov_len = piece.size;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+size_t MessageView::copy_to(void *data, size_t size) const
+{
+	size_t copied = 0;
+	for (Piece piece : *this) {
+		size_t n = std::min(piece.size, size - copied);
+		memcpy((char *)data + copied, piece.data, n);
+		copied += n;
+		if (copied == size) {
+			break;
+		}
+	}
+
+	return copied;
+}
@@ -0,0 +1,92 @@
+#ifndef UCP_SRC_UCPVIEW_HPP_
+#define UCP_SRC_UCPVIEW_HPP_
+
+#include <cstddef>
+#include <iterator>
+#include <sys/uio.h>
+
+#include "kcp/ikcp.h"
+
+namespace ucp {
+
+/**
+ * @brief a received message read in place, borrowing the kcp segments it was
+ * reassembled from. the data is read-only and stays valid until release,
+ * also after the session is closed
+ *
+ */
+class MessageView {
+public:
+	// a contiguous piece of the message
+	struct Piece {
+		const char *data;
+		size_t size;
+	};
+
+	class Iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Piece;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Piece *;
+		using reference = Piece;
+
+		explicit Iterator(const IKCPSEG *seg);
+
+		Piece operator*() const;
+		Iterator &operator++();
+		bool operator==(const Iterator &other) const;
+		bool operator!=(const Iterator &other) const;
+
+	private:
+		const IKCPSEG *seg_;
+	};
+
+	MessageView();
+	MessageView(IKCPSEG *segments, size_t size);
+	~MessageView();
+
+	MessageView(const MessageView &) = delete;
+	MessageView &operator=(const MessageView &) = delete;
+	MessageView(MessageView &&other);
+	MessageView &operator=(MessageView &&other);
+
+	/**
+	 * @brief give the segments back, the view is empty after it
+	 *
+	 */
+	void release();
+
+	size_t size() const;
+	bool empty() const;
+
+	// pieces in order
+	Iterator begin() const;
+	Iterator end() const;
+
+	/**
+	 * @brief get pieces as iovec, e.g. to forward the message by
+	 * Sock::send_to or writev
+	 *
+	 * @param iov pieces to set
+	 * @param count max number of pieces
+	 * @return size_t number of pieces of the message, more than count if iov
+	 * is too small
+	 */
+	size_t to_iovec(struct iovec *iov, size_t count) const;
+
+	/**
+	 * @brief copy the message out
+	 *
+	 * @return size_t bytes copied, at most size
+	 */
+	size_t copy_to(void *data, size_t size) const;
+
+private:
+	IKCPSEG *segments_;
+	size_t size_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPVIEW_HPP_
@@ -0,0 +1,154 @@
+#include "ucpwindow.hpp"
+
+#include <algorithm>
+
+using namespace ucp;
+
+namespace {
+
+// rounds a window must stay mostly unused before it shrinks
+constexpr uint32_t kShrinkRounds = 8;
+
+// largest window of the kcp header
+constexpr uint32_t kMaxKcpWnd = 0xffff;
+
+inline int32_t time_diff(uint32_t later, uint32_t earlier)
+{
+	return (int32_t)(later - earlier);
+}
+
+// scale segments delivered in elapsed to segments per rtt
+inline uint32_t per_rtt(uint32_t segments, uint32_t rtt, uint32_t elapsed)
+{
+	return (uint32_t)((uint64_t)segments * rtt / std::max<uint32_t>(elapsed, 1));
+}
+
+} // namespace
+
+WindowTuner::WindowTuner(const Config &config)
+	: enabled_(config.autotune)
+	, min_snd_wnd_(config.snd_wnd)
+	, min_rcv_wnd_(config.rcv_wnd)
+	, max_wnd_(std::min(config.max_wnd, kMaxKcpWnd))
+	, rtt_measuring_(false)
+	, rtt_sn_(0)
+	, rtt_start_(0)
+	, rcv_rtt_(0)
+	, rcv_start_(0)
+	, rcv_sn_(0)
+	, rcv_idle_rounds_(0)
+	, snd_start_(0)
+	, snd_una_(0)
+	, snd_idle_rounds_(0)
+{
+	max_wnd_ = std::max(max_wnd_, std::max(min_snd_wnd_, min_rcv_wnd_));
+}
+
+void WindowTuner::update(ikcpcb *kcp)
+{
+	if (!enabled_) {
+		return;
+	}
+
+	measure_rcv_rtt(kcp);
+	tune_rcv_wnd(kcp);
+	tune_snd_wnd(kcp);
+}
+
+uint32_t WindowTuner::rcv_rtt() const
+{
+	return rcv_rtt_;
+}
+
+void WindowTuner::measure_rcv_rtt(ikcpcb *kcp)
+{
+	// the peer can not send past the window before our acks reach it, so
+	// receiving a window takes at least a round trip
+	if (!rtt_measuring_) {
+		rtt_sn_ = kcp->rcv_nxt + kcp->rcv_wnd;
+		rtt_start_ = kcp->current;
+		rtt_measuring_ = true;
+		return;
+	}
+
+	if (time_diff(kcp->rcv_nxt, rtt_sn_) < 0) {
+		return;
+	}
+
+	uint32_t sample = std::max<int32_t>(time_diff(kcp->current, rtt_start_),
+										(int32_t)kcp->interval);
+	if (rcv_rtt_ == 0 || sample < rcv_rtt_) {
+		rcv_rtt_ = sample;
+	} else {
+		rcv_rtt_ = (rcv_rtt_ * 7 + sample) / 8;
+	}
+	rtt_measuring_ = false;
+}
+
+void WindowTuner::tune_rcv_wnd(ikcpcb *kcp)
+{
+	uint32_t rtt = rcv_rtt_;
+	if (kcp->rx_srtt > 0 && (rtt == 0 || (uint32_t)kcp->rx_srtt < rtt)) {
+		rtt = kcp->rx_srtt;
+	}
+
+	uint32_t elapsed = time_diff(kcp->current, rcv_start_);
+	if (rtt == 0 || elapsed < rtt) {
+		return;
+	}
+
+	// a slow reader keeps the window filled with unread data, the peer is
+	// limited by the app rather than the window then
+	uint32_t delivered = per_rtt(kcp->rcv_nxt - rcv_sn_, rtt, elapsed);
+	bool reading = kcp->nrcv_que * 2 < kcp->rcv_wnd;
+	uint32_t rcv_wnd = kcp->rcv_wnd;
+	if (reading && delivered * 2 > rcv_wnd) {
+		rcv_wnd = std::min(delivered * 2, max_wnd_);
+		rcv_idle_rounds_ = 0;
+	} else if (delivered * 4 < rcv_wnd && kcp->nrcv_buf == 0) {
+		if (++rcv_idle_rounds_ >= kShrinkRounds) {
+			rcv_wnd = std::max(rcv_wnd / 2, min_rcv_wnd_);
+			rcv_idle_rounds_ = 0;
+		}
+	} else {
+		rcv_idle_rounds_ = 0;
+	}
+
+	if (rcv_wnd != kcp->rcv_wnd) {
+		ikcp_wndsize(kcp, 0, rcv_wnd);
+	}
+
+	rcv_start_ = kcp->current;
+	rcv_sn_ = kcp->rcv_nxt;
+}
+
+void WindowTuner::tune_snd_wnd(ikcpcb *kcp)
+{
+	uint32_t rtt = kcp->rx_srtt;
+	uint32_t elapsed = time_diff(kcp->current, snd_start_);
+	if (rtt == 0 || elapsed < rtt) {
+		return;
+	}
+
+	uint32_t delivered = per_rtt(kcp->snd_una - snd_una_, rtt, elapsed);
+	bool limited = kcp->nsnd_que > 0 && kcp->nsnd_buf >= kcp->snd_wnd;
+	uint32_t snd_wnd = kcp->snd_wnd;
+	if (limited && delivered * 2 > snd_wnd) {
+		snd_wnd = std::min(delivered * 2, max_wnd_);
+		snd_idle_rounds_ = 0;
+	} else if (delivered * 4 < snd_wnd && kcp->nsnd_que == 0) {
+		if (++snd_idle_rounds_ >= kShrinkRounds) {
+			snd_wnd = std::max(snd_wnd / 2, min_snd_wnd_);
+			snd_idle_rounds_ = 0;
+		}
+	} else {
+		snd_idle_rounds_ = 0;
+	}
+
+	if (snd_wnd != kcp->snd_wnd) {
+		ikcp_wndsize(kcp, snd_wnd, 0);
+	}
+
+	snd_start_ = kcp->current;
+	snd_una_ = kcp->snd_una;
+}
@@ -0,0 +1,66 @@
+#ifndef UCP_SRC_UCPWINDOW_HPP_
+#define UCP_SRC_UCPWINDOW_HPP_
+
+#include <cstdint>
+
+#include "ucpconfig.hpp"
+#include "kcp/ikcp.h"
+
+namespace ucp {
+
+/**
+ * @brief sizes the windows of kcp to about twice the data delivered in a
+ * round trip, in the way of tcp receive buffer autotuning. windows grow
+ * while they limit the transfer and shrink back after staying mostly idle,
+ * between the windows of config and Config::max_wnd
+ *
+ */
+class WindowTuner {
+public:
+	WindowTuner() = delete;
+	explicit WindowTuner(const Config &config);
+
+	/**
+	 * @brief measure delivery and resize windows, called with the kcp lock
+	 * held after ikcp_update
+	 *
+	 */
+	void update(ikcpcb *kcp);
+
+	/**
+	 * @brief rtt measured by the receiver, the time to receive a window
+	 *
+	 * @return uint32_t millisec, 0 if not measured
+	 */
+	uint32_t rcv_rtt() const;
+
+private:
+	void measure_rcv_rtt(ikcpcb *kcp);
+	void tune_rcv_wnd(ikcpcb *kcp);
+	void tune_snd_wnd(ikcpcb *kcp);
+
+	bool enabled_;
+	uint32_t min_snd_wnd_;
+	uint32_t min_rcv_wnd_;
+	uint32_t max_wnd_;
+
+	// receiver side rtt, for peers which do not send data to ack
+	bool rtt_measuring_;
+	uint32_t rtt_sn_;
+	uint32_t rtt_start_;
+	uint32_t rcv_rtt_;
+
+	// segments delivered in order since rcv_start_
+	uint32_t rcv_start_;
+	uint32_t rcv_sn_;
+	uint32_t rcv_idle_rounds_;
+
+	// segments acked since snd_start_
+	uint32_t snd_start_;
+	uint32_t snd_una_;
+	uint32_t snd_idle_rounds_;
+};
+
+} // namespace ucp
+
+#endif // UCP_SRC_UCPWINDOW_HPP_
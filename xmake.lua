@@ -21,6 +21,12 @@ target("udpclient")
     set_languages("cxx17")
     add_files("examples/udpclient.cpp")
     add_deps("ucp")
+
+target("asyncserver")
+    set_kind("binary")
+    set_languages("cxx20")
+    add_files("examples/asyncserver.cpp")
+    add_deps("ucp")
     
     
 